@@ -80,7 +80,7 @@ inline BBox ComputeBBox(const std::vector<glm::vec4>& vertices, const std::vecto
     return bbox;
 }
 
-std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vector<uint32>& indices, float& progress)
+std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vector<uint32>& indices, float& progress, BVHChildOrder order)
 {
     std::vector<BVHNode> nodes;
     std::vector<BuildBVHTask> tasks;
@@ -268,16 +268,39 @@ std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vecto
 
         uint32 center = start + ((end - start) / 3) / 2 * 3;
 
+        BuildBVHTask lowerTask, upperTask;
+
         if (leftPrims.size() == 0 || rightPrims.size() == 0)
         {
-            tasks.push_back({ ComputeBBox(vertices, indices, center, end), center, end, task.depth + 1, true, index });
-            tasks.push_back({ ComputeBBox(vertices, indices, start, center), start, center, task.depth + 1, false, index });
+            lowerTask = { ComputeBBox(vertices, indices, start, center), start, center, task.depth + 1, false, index };
+            upperTask = { ComputeBBox(vertices, indices, center, end), center, end, task.depth + 1, true, index };
+        }
+        else
+        {
+            lowerTask = { bboxLeft, start, start + uint32(leftPrims.size()), task.depth + 1, false, index };
+            upperTask = { bboxRight, start + uint32(leftPrims.size()), end, task.depth + 1, true, index };
+        }
+
+        if (order == BVHChildOrder::LargerFirst)
+        {
+            glm::vec3 lowerSize = lowerTask.bbox.GetSize();
+            glm::vec3 upperSize = upperTask.bbox.GetSize();
+
+            leftFirst = dot(lowerSize, lowerSize) >= dot(upperSize, upperSize);
         }
         else
         {
-            tasks.push_back({ bboxRight, start + uint32(leftPrims.size()), end, task.depth + 1, true, index });
-            tasks.push_back({ bboxLeft, start, start + uint32(leftPrims.size()), task.depth + 1, false, index });
+            leftFirst = true;
         }
+
+        // The task popped first is placed at index + 1, the other one becomes node.right
+        BuildBVHTask first = leftFirst ? lowerTask : upperTask;
+        BuildBVHTask second = leftFirst ? upperTask : lowerTask;
+        first.isRight = false;
+        second.isRight = true;
+
+        tasks.push_back(second);
+        tasks.push_back(first);
     }
 
     // Fill in the skip connections (next*)
@@ -308,6 +331,50 @@ std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vecto
     return nodes;
 }
 
+void ReorderVerticesToBVH(const std::vector<BVHNode>& nodes, std::vector<glm::vec4>& vertices, std::vector<VertexAux>& vertexAux, std::vector<uint32>& indices)
+{
+    const uint32 unassigned = ~0u;
+    std::vector<uint32> newIndex(vertices.size(), unassigned);
+    std::vector<uint32> oldIndex;
+    oldIndex.reserve(vertices.size());
+
+    auto assign = [&](uint32 v)
+    {
+        if (newIndex[v] == unassigned)
+        {
+            newIndex[v] = uint32(oldIndex.size());
+            oldIndex.push_back(v);
+        }
+    };
+
+    for (const BVHNode& node : nodes)
+    {
+        if (node.right > 0) continue;
+
+        uint32 offset = uint32(-node.right);
+        assign(indices[offset]);
+        assign(indices[offset + 1]);
+        assign(indices[offset + 2]);
+    }
+
+    // Triangles without a leaf and unreferenced vertices keep their relative order at the end
+    for (uint32 v : indices) assign(v);
+    for (uint32 v = 0; v < vertices.size(); v++) assign(v);
+
+    std::vector<glm::vec4> reorderedVertices(vertices.size());
+    std::vector<VertexAux> reorderedAux(vertexAux.size());
+    for (uint32 i = 0; i < oldIndex.size(); i++)
+    {
+        reorderedVertices[i] = vertices[oldIndex[i]];
+        reorderedAux[i] = vertexAux[oldIndex[i]];
+    }
+
+    vertices.swap(reorderedVertices);
+    vertexAux.swap(reorderedAux);
+
+    for (uint32& v : indices) v = newIndex[v];
+}
+
 void VisualizeBVH(std::vector<BVHNode>& nodes, std::vector<glm::vec4>& vertices, std::vector<VertexAux>& vertexAux, std::vector<glm::uint32>& indices)
 {
     uint32 startVertex = 0;
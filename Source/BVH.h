@@ -32,5 +32,17 @@ struct BVHNode
     int32 right;
 };
 
-std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vector<uint32>& indices, float& progress);
+// Which child of a split is laid out right after its parent (and therefore visited first by the stackless traversal)
+enum class BVHChildOrder
+{
+    Split,          // Lower side of the split plane first
+    LargerFirst,    // Larger child first, a shadow ray is more likely to find an occluder early there
+};
+
+std::vector<BVHNode> BuildBVH(const std::vector<glm::vec4>& vertices, std::vector<uint32>& indices, float& progress, BVHChildOrder order = BVHChildOrder::Split);
+
+// Renumbers vertices in the order the leaves first use them (preorder = traversal order) and rewrites indices to match,
+// so neighbouring leaves read neighbouring vertices. Nodes are left untouched.
+void ReorderVerticesToBVH(const std::vector<BVHNode>& nodes, std::vector<glm::vec4>& vertices, std::vector<VertexAux>& vertexAux, std::vector<uint32>& indices);
+
 void VisualizeBVH(std::vector<BVHNode>& nodes, std::vector<glm::vec4>& vertices, std::vector<VertexAux>& vertexAux, std::vector<glm::uint32>& indices);
\ No newline at end of file
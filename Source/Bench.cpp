@@ -0,0 +1,381 @@
+#include <Ganymede/Source/Ganymede.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "ShaderData.h"
+#include "BVH.h"
+#include "Tracer.h"
+#include "SceneLoader.h"
+
+// Throughput benchmark over the bundled scenes:
+//   PathTracerBench [modelDir] [--width W] [--height H] [--out prefix]
+// Writes <prefix>.json and <prefix>.csv with build times, BVH size and Mrays/s per ray type.
+
+// PCG hash, every ray is a pure function of its index so runs are comparable
+inline uint32 Hash(uint32 v)
+{
+    uint32 state = v * 747796405u + 2891336453u;
+    uint32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+inline float HashF(uint32 v)
+{
+    return float(Hash(v) >> 8) / float(1 << 24);
+}
+
+using BenchClock = std::chrono::high_resolution_clock;
+
+inline double ElapsedMs(BenchClock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::duration<double>>(BenchClock::now() - start).count() * 1000.0;
+}
+
+struct RayBatchResult
+{
+    std::string name;
+    uint64 rays = 0;
+    uint64 hits = 0;
+    double ms = 0.0;
+    TraceStats stats;
+    bool shaded = true; // Hits fetch the vertex aux data of their triangle
+};
+
+// Vertex attribute bytes per ray the GPU kernels fetch for a batch: three positions per tested triangle
+// and three aux entries per shaded hit. Used to compare the float and the packed vertex layouts.
+inline double VertexBytesPerRay(const RayBatchResult& batch, uint64 positionSize, uint64 auxSize)
+{
+    uint64 bytes = batch.stats.trianglesTested * 3 * positionSize + (batch.shaded ? batch.hits * 3 * auxSize : 0);
+    return double(bytes) / double(std::max<uint64>(batch.rays, 1));
+}
+
+inline double FloatVertexBytesPerRay(const RayBatchResult& batch) { return VertexBytesPerRay(batch, sizeof(glm::vec4), sizeof(VertexAux)); }
+inline double PackedVertexBytesPerRay(const RayBatchResult& batch) { return VertexBytesPerRay(batch, sizeof(glm::vec3), sizeof(PackedVertexAux)); }
+
+struct SceneResult
+{
+    std::string scene;
+    uint64 vertices = 0;
+    uint64 triangles = 0;
+    double loadMs = 0.0;
+    double buildMs = 0.0;
+    double reorderMs = 0.0;
+    uint64 bvhNodes = 0;
+    uint64 bvhBytes = 0;
+    std::vector<RayBatchResult> batches;
+};
+
+// Runs trace(i, stats) for every ray index on all hardware threads, trace returns whether the ray hit
+RayBatchResult RunBatch(const std::string& name, uint32 count, const std::function<bool(uint32, TraceStats&)>& trace)
+{
+    RayBatchResult result;
+    result.name = name;
+    result.rays = count;
+
+    const uint32 chunkSize = 1024;
+    std::atomic<uint32> nextChunk = 0;
+    std::mutex resultLock;
+
+    auto start = BenchClock::now();
+
+    std::vector<std::thread> threads;
+    for (uint32 t = 0; t < std::max(1u, std::thread::hardware_concurrency()); t++)
+    {
+        threads.push_back(std::thread([&]()
+        {
+            TraceStats stats;
+            uint64 hits = 0;
+
+            while (true)
+            {
+                uint32 begin = nextChunk.fetch_add(1) * chunkSize;
+                if (begin >= count) break;
+
+                uint32 end = std::min(count, begin + chunkSize);
+                for (uint32 i = begin; i < end; i++)
+                {
+                    if (trace(i, stats)) hits++;
+                }
+            }
+
+            std::lock_guard<std::mutex> lk(resultLock);
+            result.hits += hits;
+            result.stats.nodesVisited += stats.nodesVisited;
+            result.stats.trianglesTested += stats.trianglesTested;
+        }));
+    }
+
+    for (auto& t : threads) t.join();
+
+    result.ms = ElapsedMs(start);
+
+    return result;
+}
+
+glm::vec3 CosineHemisphere(glm::vec3 n, float u, float v)
+{
+    float theta = 2.0f * 3.1415926f * v;
+    float sqrtU = std::sqrt(u);
+
+    glm::vec3 h = (std::abs(n.x) > 0.9f) ? glm::vec3(0.0, 1.0, 0.0) : glm::vec3(1.0, 0.0, 0.0);
+    glm::vec3 y = glm::normalize(glm::cross(h, n));
+    glm::vec3 x = glm::cross(n, y);
+
+    return x * (std::cos(theta) * sqrtU) + y * (std::sin(theta) * sqrtU) + n * std::sqrt(1.0f - u);
+}
+
+SceneResult BenchScene(const std::string& file, uint32 width, uint32 height)
+{
+    SceneResult result;
+    result.scene = std::filesystem::path(file).filename().string();
+
+    std::vector<glm::vec4> vertexPosition;
+    std::vector<VertexAux> vertexAuxilary;
+    std::vector<uint32> indices;
+
+    auto loadStart = BenchClock::now();
+    LoadPly(file, vertexPosition, vertexAuxilary, indices);
+    result.loadMs = ElapsedMs(loadStart);
+
+    // Unreadable or malformed, reported by LoadPly. triangles stays 0.
+    if (indices.empty()) return result;
+
+    float progress = 0.0f;
+    auto buildStart = BenchClock::now();
+    std::vector<BVHNode> nodes = BuildBVH(vertexPosition, indices, progress, BVHChildOrder::LargerFirst);
+    result.buildMs = ElapsedMs(buildStart);
+
+    // Timed on its own, build_ms stays comparable with results from before the reorder existed
+    auto reorderStart = BenchClock::now();
+    ReorderVerticesToBVH(nodes, vertexPosition, vertexAuxilary, indices);
+    result.reorderMs = ElapsedMs(reorderStart);
+
+    result.vertices = vertexPosition.size();
+    result.triangles = indices.size() / 3;
+    result.bvhNodes = nodes.size();
+    result.bvhBytes = nodes.size() * sizeof(BVHNode);
+
+    // Same camera & light as the app defaults (orbit radius 3, height 0.5, angle 0, 60 degree fov)
+    const glm::vec3 eye = glm::vec3(3.0, 0.5, 0.0);
+    const glm::vec3 lightPos = glm::vec3(0.0, 1.4, 0.0);
+
+    glm::vec3 forward = glm::normalize(-eye);
+    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0, 1.0, 0.0)));
+    glm::vec3 up = glm::cross(right, forward);
+    float tanHalfFov = std::tan(glm::radians(30.0f));
+    float aspect = float(width) / float(height);
+
+    const uint32 numPixels = width * height;
+
+    std::vector<Ray> primaryRays(numPixels);
+    for (uint32 i = 0; i < numPixels; i++)
+    {
+        float x = ((float(i % width) + HashF(i * 2)) / float(width)) * 2.0f - 1.0f;
+        float y = ((float(i / width) + HashF(i * 2 + 1)) / float(height)) * 2.0f - 1.0f;
+
+        glm::vec3 d = glm::normalize(forward + right * (x * tanHalfFov * aspect) - up * (y * tanHalfFov));
+        primaryRays[i] = Ray(eye, d, 0.001f, 100000.0f);
+    }
+
+    // Primary
+    std::vector<Intersection> hits(numPixels);
+    std::vector<float> hitT(numPixels, -1.0f);
+
+    result.batches.push_back(RunBatch("primary", numPixels, [&](uint32 i, TraceStats& stats)
+    {
+        Ray r = primaryRays[i];
+        if (!TraceRay(nodes, vertexPosition, indices, r, hits[i], &stats)) return false;
+
+        hitT[i] = r.max_t;
+        return true;
+    }));
+
+    // Build secondary rays from the primary hits, misses don't spawn anything
+    std::vector<Ray> shadowRays;
+    std::vector<Ray> diffuseRays;
+
+    for (uint32 i = 0; i < numPixels; i++)
+    {
+        if (hitT[i] < 0.0f) continue;
+
+        const Ray& r = primaryRays[i];
+        glm::vec3 hitPos = r.o + r.d * hitT[i];
+
+        glm::vec3 p1 = vertexPosition[hits[i].i1];
+        glm::vec3 p2 = vertexPosition[hits[i].i2];
+        glm::vec3 p3 = vertexPosition[hits[i].i3];
+        glm::vec3 n = glm::cross(p2 - p1, p3 - p1);
+        if (glm::dot(n, n) <= 0.0f) continue;
+
+        n = glm::normalize(n);
+        if (glm::dot(n, r.d) > 0.0f) n = -n;
+
+        glm::vec3 origin = hitPos + n * 0.0001f;
+
+        glm::vec3 toLight = lightPos - origin;
+        float dist = glm::length(toLight);
+        shadowRays.push_back(Ray(origin, toLight / dist, 0.0001f, dist - 0.00005f));
+
+        diffuseRays.push_back(Ray(origin, CosineHemisphere(n, HashF(i * 3 + numPixels * 2), HashF(i * 3 + 1 + numPixels * 2)), 0.0001f, 10000.0f));
+    }
+
+    // Shadow, one occluder cache slot per ray like the per pixel cache on the GPU.
+    // Cold starts from empty slots. Warm seeds every slot with the occluder the cold pass found for the previous ray in
+    // pixel order, a nearby but different ray like the previous frame's jittered ray of the same pixel.
+    std::vector<uint32> occluderCache(shadowRays.size(), 0);
+
+    result.batches.push_back(RunBatch("shadow_cold", uint32(shadowRays.size()), [&](uint32 i, TraceStats& stats)
+    {
+        return TraceOcclusion(nodes, vertexPosition, indices, shadowRays[i], &occluderCache[i], &stats);
+    }));
+    result.batches.back().shaded = false;
+
+    std::vector<uint32> warmCache(shadowRays.size(), 0);
+    for (size_t i = 1; i < shadowRays.size(); i++) warmCache[i] = occluderCache[i - 1];
+
+    result.batches.push_back(RunBatch("shadow_warm", uint32(shadowRays.size()), [&](uint32 i, TraceStats& stats)
+    {
+        return TraceOcclusion(nodes, vertexPosition, indices, shadowRays[i], &warmCache[i], &stats);
+    }));
+    result.batches.back().shaded = false;
+
+    // Diffuse bounce
+    result.batches.push_back(RunBatch("diffuse", uint32(diffuseRays.size()), [&](uint32 i, TraceStats& stats)
+    {
+        Ray r = diffuseRays[i];
+        Intersection isect;
+        return TraceRay(nodes, vertexPosition, indices, r, isect, &stats);
+    }));
+
+    return result;
+}
+
+void WriteReport(const std::string& prefix, const std::vector<SceneResult>& results)
+{
+    std::ofstream json(prefix + ".json");
+    json << "[\n";
+    for (size_t s = 0; s < results.size(); s++)
+    {
+        const SceneResult& r = results[s];
+        json << "  {\n";
+        json << "    \"scene\": \"" << r.scene << "\",\n";
+        json << "    \"vertices\": " << r.vertices << ",\n";
+        json << "    \"triangles\": " << r.triangles << ",\n";
+        json << "    \"load_ms\": " << r.loadMs << ",\n";
+        json << "    \"build_ms\": " << r.buildMs << ",\n";
+        json << "    \"reorder_ms\": " << r.reorderMs << ",\n";
+        json << "    \"bvh_nodes\": " << r.bvhNodes << ",\n";
+        json << "    \"bvh_bytes\": " << r.bvhBytes << ",\n";
+        json << "    \"rays\": {\n";
+        for (size_t b = 0; b < r.batches.size(); b++)
+        {
+            const RayBatchResult& batch = r.batches[b];
+            double rays = double(std::max<uint64>(batch.rays, 1));
+            json << "      \"" << batch.name << "\": { ";
+            json << "\"count\": " << batch.rays << ", ";
+            json << "\"hits\": " << batch.hits << ", ";
+            json << "\"ms\": " << batch.ms << ", ";
+            json << "\"mrays_per_s\": " << (batch.rays / 1000.0) / std::max(batch.ms, 1e-6) << ", ";
+            json << "\"nodes_per_ray\": " << batch.stats.nodesVisited / rays << ", ";
+            json << "\"triangles_per_ray\": " << batch.stats.trianglesTested / rays << ", ";
+            json << "\"vertex_bytes_per_ray\": " << FloatVertexBytesPerRay(batch) << ", ";
+            json << "\"packed_vertex_bytes_per_ray\": " << PackedVertexBytesPerRay(batch);
+            json << " }" << (b + 1 < r.batches.size() ? "," : "") << "\n";
+        }
+        json << "    }\n";
+        json << "  }" << (s + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "]\n";
+
+    std::ofstream csv(prefix + ".csv");
+    csv << "scene,vertices,triangles,load_ms,build_ms,reorder_ms,bvh_nodes,bvh_bytes,ray_type,rays,hits,ms,mrays_per_s,nodes_per_ray,triangles_per_ray,vertex_bytes_per_ray,packed_vertex_bytes_per_ray\n";
+    for (const SceneResult& r : results)
+    {
+        for (const RayBatchResult& batch : r.batches)
+        {
+            double rays = double(std::max<uint64>(batch.rays, 1));
+            csv << r.scene << "," << r.vertices << "," << r.triangles << "," << r.loadMs << "," << r.buildMs << "," << r.reorderMs << ","
+                << r.bvhNodes << "," << r.bvhBytes << "," << batch.name << "," << batch.rays << "," << batch.hits << ","
+                << batch.ms << "," << (batch.rays / 1000.0) / std::max(batch.ms, 1e-6) << ","
+                << batch.stats.nodesVisited / rays << "," << batch.stats.trianglesTested / rays << ","
+                << FloatVertexBytesPerRay(batch) << "," << PackedVertexBytesPerRay(batch) << "\n";
+        }
+    }
+}
+
+// Models/ may contain git-lfs pointers instead of the actual files
+bool IsPlyFile(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ifstream::binary);
+    char magic[3] = {};
+    file.read(magic, 3);
+    return file && magic[0] == 'p' && magic[1] == 'l' && magic[2] == 'y';
+}
+
+int main(int argc, char** argv)
+{
+    std::string modelDir = "../Models";
+    std::string prefix = "PathTracerBench";
+    uint32 width = 512;
+    uint32 height = 512;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--width" && i + 1 < argc) width = uint32(std::stoul(argv[++i]));
+        else if (arg == "--height" && i + 1 < argc) height = uint32(std::stoul(argv[++i]));
+        else if (arg == "--out" && i + 1 < argc) prefix = argv[++i];
+        else modelDir = arg;
+    }
+
+    std::vector<std::filesystem::path> scenes;
+    for (const auto& entry : std::filesystem::directory_iterator(modelDir))
+    {
+        if (entry.path().extension() == ".ply") scenes.push_back(entry.path());
+    }
+    std::sort(scenes.begin(), scenes.end());
+
+    std::vector<SceneResult> results;
+
+    for (const auto& scene : scenes)
+    {
+        if (!IsPlyFile(scene))
+        {
+            GanymedePrint "Skipping", scene.string(), "(not a PLY file, git-lfs pointer?)";
+            continue;
+        }
+
+        GanymedePrint "Benchmarking", scene.string();
+
+        SceneResult result = BenchScene(scene.string(), width, height);
+        if (result.triangles == 0)
+        {
+            GanymedePrint "Skipping", scene.string(), "(no triangles)";
+            continue;
+        }
+
+        GanymedePrint "  load", result.loadMs, "ms, build", result.buildMs, "ms, reorder", result.reorderMs, "ms,", result.bvhBytes, "BVH bytes";
+        for (const RayBatchResult& batch : result.batches)
+        {
+            GanymedePrint "  ", batch.name, (batch.rays / 1000.0) / std::max(batch.ms, 1e-6), "Mrays/s,",
+                double(batch.stats.nodesVisited) / std::max<uint64>(batch.rays, 1), "nodes/ray,",
+                double(batch.stats.trianglesTested) / std::max<uint64>(batch.rays, 1), "triangles/ray,",
+                FloatVertexBytesPerRay(batch), "->", PackedVertexBytesPerRay(batch), "vertex bytes/ray";
+        }
+
+        results.push_back(result);
+    }
+
+    WriteReport(prefix, results);
+
+    GanymedePrint "Wrote", prefix + ".json", "and", prefix + ".csv";
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "GpuBVH.h"
+
+#include "bvhbuild_reset.comp.h"
+#include "bvhbuild_bounds.comp.h"
+#include "bvhbuild_morton.comp.h"
+#include "bvhbuild_histogram.comp.h"
+#include "bvhbuild_scan.comp.h"
+#include "bvhbuild_scatter.comp.h"
+#include "bvhbuild_hierarchy.comp.h"
+#include "bvhbuild_refit.comp.h"
+#include "bvhbuild_emit.comp.h"
+
+#include "BVH.h"
+
+// Every bvhbuild.comp pass runs RADIX_DIGITS threads per workgroup
+#define BVH_BUILD_GROUP_SIZE RADIX_DIGITS
+
+static void ComputeBarrier(EuropaCmdlist::Ref cmdlist, EuropaBuffer::Ref buffer, uint32 size)
+{
+    cmdlist->Barrier(
+        buffer, size, 0,
+        EuropaAccessShaderWrite, EuropaAccessShaderRead,
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+}
+
+static uint32 BuildNodesSize(uint32 numTriangles)
+{
+    return uint32(GpuBVHNodeCount(numTriangles) * sizeof(BVHBuildNode));
+}
+
+// Centroid min / max
+static const uint32 BuildStateSize = 6 * sizeof(uint32);
+
+static uint32 SortPairsSize(uint32 numTriangles)
+{
+    return uint32(numTriangles * 2 * sizeof(glm::uvec2));
+}
+
+static uint32 SortStateSize(uint32 numTriangles)
+{
+    uint32 numBlocks = (numTriangles + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+    return uint32((2 + numBlocks * RADIX_DIGITS) * sizeof(uint32));
+}
+
+GpuBVHBuilder CreateGpuBVHBuilder(EuropaDevice::Ref device)
+{
+    GpuBVHBuilder builder;
+
+    // Same binding numbers as the trace passes for the buffers both use
+    builder.descLayout = device->CreateDescriptorSetLayout();
+    builder.descLayout->DynamicUniformBuffer(0, 1, EuropaShaderStageCompute);
+    builder.descLayout->BufferViewUniform(3, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(7, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(8, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(20, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(21, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(23, 1, EuropaShaderStageCompute);
+    builder.descLayout->Storage(24, 1, EuropaShaderStageCompute);
+    builder.descLayout->Build();
+
+    builder.layout = device->CreatePipelineLayout(EuropaPipelineLayoutInfo{ 1, 0, &builder.descLayout });
+
+    ComputePipelineBatch batch(device, builder.layout);
+    batch.Add(builder.reset, shader_spv_bvhbuild_reset_comp_h);
+    batch.Add(builder.bounds, shader_spv_bvhbuild_bounds_comp_h);
+    batch.Add(builder.morton, shader_spv_bvhbuild_morton_comp_h);
+    batch.Add(builder.radixHistogram, shader_spv_bvhbuild_histogram_comp_h);
+    batch.Add(builder.radixScan, shader_spv_bvhbuild_scan_comp_h);
+    batch.Add(builder.radixScatter, shader_spv_bvhbuild_scatter_comp_h);
+    batch.Add(builder.hierarchy, shader_spv_bvhbuild_hierarchy_comp_h);
+    batch.Add(builder.refit, shader_spv_bvhbuild_refit_comp_h);
+    batch.Add(builder.emit, shader_spv_bvhbuild_emit_comp_h);
+    batch.Wait();
+
+    return builder;
+}
+
+GpuBVHBuild CreateGpuBVHBuild(EuropaDevice::Ref device, const GpuBVHBuilder& builder, const TraceSceneBuffers& buffers, uint32 numTriangles, EuropaMemoryUsage nodesMemory)
+{
+    GpuBVHBuild build;
+    build.numTriangles = numTriangles;
+
+    build.nodesSize = uint32(GpuBVHNodeCount(numTriangles) * sizeof(BVHNode));
+
+    EuropaBufferInfo nodesInfo;
+    nodesInfo.exclusive = true;
+    nodesInfo.size = build.nodesSize;
+    nodesInfo.usage = EuropaBufferUsageStorage;
+    nodesInfo.memoryUsage = nodesMemory;
+    build.nodes = device->CreateBuffer(nodesInfo);
+
+    // Only numTriangles is read
+    EuropaBufferInfo constantsInfo;
+    constantsInfo.exclusive = true;
+    constantsInfo.size = sizeof(ShaderConstants);
+    constantsInfo.usage = EuropaBufferUsageUniform;
+    constantsInfo.memoryUsage = EuropaMemoryUsage::Cpu2Gpu;
+    build.constants = device->CreateBuffer(constantsInfo);
+
+    ShaderConstants* constants = build.constants->Map<ShaderConstants>();
+    *constants = {};
+    constants->numTriangles = numTriangles;
+    constants->numBVHNodes = GpuBVHNodeCount(numTriangles);
+    build.constants->Unmap();
+
+    build.buildNodes = CreateGpuBuffer(device, BuildNodesSize(numTriangles), EuropaBufferUsageStorage);
+    build.buildState = CreateGpuBuffer(device, BuildStateSize, EuropaBufferUsageStorage);
+    build.sortPairs = CreateGpuBuffer(device, SortPairsSize(numTriangles), EuropaBufferUsageStorage);
+    build.sortState = CreateGpuBuffer(device, SortStateSize(numTriangles), EuropaBufferUsageStorage);
+
+    EuropaDescriptorPoolSizes descPoolSizes;
+    descPoolSizes.UniformDynamic = 1;
+    descPoolSizes.UniformTexel = 1;
+    descPoolSizes.Storage = 6;
+
+    build.descPool = device->CreateDescriptorPool(descPoolSizes, 1);
+    build.descSet = build.descPool->AllocateDescriptorSet(builder.descLayout);
+
+    build.descSet->SetUniformBufferDynamic(build.constants, 0, uint32(sizeof(ShaderConstants)), 0, 0);
+    build.descSet->SetBufferViewUniform(buffers.indexView, 3, 0);
+    build.descSet->SetStorage(buffers.positions, 0, buffers.positionsSize, 7, 0);
+    build.descSet->SetStorage(build.nodes, 0, build.nodesSize, 8, 0);
+    build.descSet->SetStorage(build.sortPairs, 0, SortPairsSize(numTriangles), 20, 0);
+    build.descSet->SetStorage(build.sortState, 0, SortStateSize(numTriangles), 21, 0);
+    build.descSet->SetStorage(build.buildNodes, 0, BuildNodesSize(numTriangles), 23, 0);
+    build.descSet->SetStorage(build.buildState, 0, BuildStateSize, 24, 0);
+
+    return build;
+}
+
+void RecordGpuBVHBuild(EuropaCmdlist::Ref cmdlist, const GpuBVHBuilder& builder, const GpuBVHBuild& build)
+{
+    uint32 numTriangles = build.numTriangles;
+    uint32 triangleGroups = (numTriangles + BVH_BUILD_GROUP_SIZE - 1) / BVH_BUILD_GROUP_SIZE;
+    uint32 nodeGroups = (GpuBVHNodeCount(numTriangles) + BVH_BUILD_GROUP_SIZE - 1) / BVH_BUILD_GROUP_SIZE;
+    uint32 sortBlocks = (numTriangles + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+
+    uint32 buildNodesSize = BuildNodesSize(numTriangles);
+    uint32 pairsSize = SortPairsSize(numTriangles);
+    uint32 sortStateSize = SortStateSize(numTriangles);
+
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, builder.layout, build.descSet, 0, 0);
+
+    cmdlist->BindCompute(builder.reset);
+    cmdlist->Dispatch(1, 1, 1);
+
+    ComputeBarrier(cmdlist, build.buildState, BuildStateSize);
+    ComputeBarrier(cmdlist, build.sortState, sortStateSize);
+
+    cmdlist->BindCompute(builder.bounds);
+    cmdlist->Dispatch(triangleGroups, 1, 1);
+
+    ComputeBarrier(cmdlist, build.buildState, BuildStateSize);
+
+    cmdlist->BindCompute(builder.morton);
+    cmdlist->Dispatch(triangleGroups, 1, 1);
+
+    for (uint32 pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        ComputeBarrier(cmdlist, build.sortPairs, pairsSize);
+        ComputeBarrier(cmdlist, build.sortState, sortStateSize);
+
+        cmdlist->BindCompute(builder.radixHistogram);
+        cmdlist->Dispatch(sortBlocks, 1, 1);
+
+        ComputeBarrier(cmdlist, build.sortState, sortStateSize);
+
+        cmdlist->BindCompute(builder.radixScan);
+        cmdlist->Dispatch(1, 1, 1);
+
+        ComputeBarrier(cmdlist, build.sortState, sortStateSize);
+
+        cmdlist->BindCompute(builder.radixScatter);
+        cmdlist->Dispatch(sortBlocks, 1, 1);
+    }
+
+    ComputeBarrier(cmdlist, build.sortPairs, pairsSize);
+    ComputeBarrier(cmdlist, build.buildNodes, buildNodesSize);
+
+    // A single triangle is a leaf root without internal nodes
+    if (numTriangles > 1)
+    {
+        cmdlist->BindCompute(builder.hierarchy);
+        cmdlist->Dispatch((numTriangles - 1 + BVH_BUILD_GROUP_SIZE - 1) / BVH_BUILD_GROUP_SIZE, 1, 1);
+
+        ComputeBarrier(cmdlist, build.buildNodes, buildNodesSize);
+    }
+
+    cmdlist->BindCompute(builder.refit);
+    cmdlist->Dispatch(triangleGroups, 1, 1);
+
+    ComputeBarrier(cmdlist, build.buildNodes, buildNodesSize);
+
+    cmdlist->BindCompute(builder.emit);
+    cmdlist->Dispatch(nodeGroups, 1, 1);
+
+    ComputeBarrier(cmdlist, build.nodes, build.nodesSize);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Europa/Source/Europa.h"
+#include "Ganymede/Source/Ganymede.h"
+
+#include "ShaderData.h"
+#include "TracePasses.h"
+
+// LBVH build on the GPU (shaders/bvhbuild.comp) from the uploaded positions and indices, in the BVHNode layout
+// BuildBVH produces: preorder, skip links in next, leaves point at their triangle with right = -index offset.
+// The triangles are not reordered, so the result works with the index buffer as uploaded.
+// Trades some trace performance (Morton splits instead of binned SAH) for a build that never leaves the device.
+
+struct GpuBVHBuilder
+{
+    EuropaDescriptorSetLayout::Ref descLayout;
+    EuropaPipelineLayout::Ref layout;
+
+    EuropaPipeline::Ref reset;
+    EuropaPipeline::Ref bounds;
+    EuropaPipeline::Ref morton;
+    EuropaPipeline::Ref radixHistogram;
+    EuropaPipeline::Ref radixScan;
+    EuropaPipeline::Ref radixScatter;
+    EuropaPipeline::Ref hierarchy;
+    EuropaPipeline::Ref refit;
+    EuropaPipeline::Ref emit;
+};
+
+// Output and scratch buffers for one triangle count
+struct GpuBVHBuild
+{
+    uint32 numTriangles = 0;
+
+    EuropaBuffer::Ref nodes; // GpuBVHNodeCount(numTriangles) BVHNodes
+    uint32 nodesSize = 0;
+
+    EuropaBuffer::Ref constants;
+    EuropaBuffer::Ref buildNodes;
+    EuropaBuffer::Ref buildState;
+    EuropaBuffer::Ref sortPairs;
+    EuropaBuffer::Ref sortState;
+
+    EuropaDescriptorPool::Ref descPool;
+    EuropaDescriptorSet::Ref descSet;
+};
+
+inline uint32 GpuBVHNodeCount(uint32 numTriangles)
+{
+    return 2 * numTriangles - 1;
+}
+
+GpuBVHBuilder CreateGpuBVHBuilder(EuropaDevice::Ref device);
+
+// Reads buffers.positions and buffers.indexView. nodesMemory = Gpu2Cpu makes the nodes readable on the host.
+GpuBVHBuild CreateGpuBVHBuild(EuropaDevice::Ref device, const GpuBVHBuilder& builder, const TraceSceneBuffers& buffers, uint32 numTriangles, EuropaMemoryUsage nodesMemory = EuropaMemoryUsage::GpuOnly);
+
+// Records the whole build, build.nodes is ready for the trace passes afterwards
+void RecordGpuBVHBuild(EuropaCmdlist::Ref cmdlist, const GpuBVHBuilder& builder, const GpuBVHBuild& build);
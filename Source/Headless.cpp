@@ -0,0 +1,590 @@
+#include "Europa/Source/EuropaVk.h"
+#include "Ganymede/Source/Ganymede.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+
+#include <glm/gtx/transform.hpp>
+
+#include "ShaderData.h"
+#include "SceneCache.h"
+#include "LightTree.h"
+#include "TracePasses.h"
+#include "GpuBVH.h"
+#include "Tracer.h"
+#include "PassProfiler.h"
+
+// Offscreen batch renderer, no window or swapchain:
+//   PathTracerHeadless scene.ply [--out render.pfm] [--size w h] [--tile w h] [--spp n] [--batch n] [--depth d]
+//                      [--eye x y z] [--center x y z] [--ambient r g b] [--emissive threshold strength] [--no-sort]
+//                      [--compact] [--persistent groups] [--wavefront] [--forward] [--gpu-bvh] [--validate-bvh]
+//                      [--adaptive threshold] [--profile timings.csv]
+// Runs the same launch / trace / raysort / resolve passes as the app for spp frames, then writes the accumulated
+// mean to --out: .pfm keeps linear radiance, anything else is written as a tonemapped binary .ppm.
+// Only needs a compute queue, so it runs on software ICDs such as lavapipe (select it with VK_ICD_FILENAMES).
+// --depth is at least 1, and at most WAVEFRONT_MAX_DEPTH (8) with --wavefront.
+// --profile submits every pass on its own and writes their times per frame to a CSV file, see PassProfiler.h.
+
+struct HeadlessOptions
+{
+    std::string scene;
+    std::string output = "render.pfm";
+    glm::uvec2 size = glm::uvec2(1280, 720);
+    glm::uvec2 tileSize = glm::uvec2(0); // Whole frame
+    uint32 spp = 64;
+    uint32 samplesPerFrame = 1; // Samples per pixel traced by each submission, spp is rounded up to a multiple
+    uint32 maxDepth = 5;
+    glm::vec3 eye = glm::vec3(3.0, 0.5, 0.0); // App's default orbit
+    glm::vec3 center = glm::vec3(0.0);
+    glm::vec3 ambientRadiance = glm::vec3(0.4, 0.5, 0.7);
+    bool raySort = true;
+    bool compaction = false;
+    uint32 persistentGroups = 0;
+    bool wavefront = false;
+    bool forwardAccumulation = false;
+    bool gpuBVH = false;
+    bool validateBVH = false; // Compare the GPU BVH with the CPU one before rendering
+    float convergenceThreshold = 0.0f; // Adaptive sampling, spp is then the maximum per pixel
+    std::string profileLog; // Per pass timings CSV, empty = no profiling
+    bool emissiveTriangles = false;
+    float emissiveThreshold = 1.0f;
+    float emissiveStrength = 10.0f;
+};
+
+static bool ParseOptions(int argc, char** argv, HeadlessOptions& options)
+{
+    auto vec3Arg = [&](int i) { return glm::vec3(std::stof(argv[i]), std::stof(argv[i + 1]), std::stof(argv[i + 2])); };
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) options.output = argv[++i];
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            options.size = glm::uvec2(std::stoul(argv[i + 1]), std::stoul(argv[i + 2]));
+            i += 2;
+        }
+        else if (arg == "--tile" && i + 2 < argc)
+        {
+            options.tileSize = glm::uvec2(std::stoul(argv[i + 1]), std::stoul(argv[i + 2]));
+            i += 2;
+        }
+        else if (arg == "--spp" && i + 1 < argc) options.spp = uint32(std::stoul(argv[++i]));
+        else if (arg == "--batch" && i + 1 < argc) options.samplesPerFrame = uint32(std::stoul(argv[++i]));
+        else if (arg == "--depth" && i + 1 < argc) options.maxDepth = uint32(std::stoul(argv[++i]));
+        else if (arg == "--eye" && i + 3 < argc)
+        {
+            options.eye = vec3Arg(i + 1);
+            i += 3;
+        }
+        else if (arg == "--center" && i + 3 < argc)
+        {
+            options.center = vec3Arg(i + 1);
+            i += 3;
+        }
+        else if (arg == "--ambient" && i + 3 < argc)
+        {
+            options.ambientRadiance = vec3Arg(i + 1);
+            i += 3;
+        }
+        else if (arg == "--emissive" && i + 2 < argc)
+        {
+            options.emissiveTriangles = true;
+            options.emissiveThreshold = std::stof(argv[i + 1]);
+            options.emissiveStrength = std::stof(argv[i + 2]);
+            i += 2;
+        }
+        else if (arg == "--no-sort") options.raySort = false;
+        else if (arg == "--compact") options.compaction = true;
+        else if (arg == "--persistent" && i + 1 < argc) options.persistentGroups = uint32(std::stoul(argv[++i]));
+        else if (arg == "--wavefront") options.wavefront = true;
+        else if (arg == "--forward") options.forwardAccumulation = true;
+        else if (arg == "--gpu-bvh") options.gpuBVH = true;
+        else if (arg == "--validate-bvh") options.gpuBVH = options.validateBVH = true;
+        else if (arg == "--adaptive" && i + 1 < argc) options.convergenceThreshold = std::stof(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc) options.profileLog = argv[++i];
+        else if (options.scene.empty() && arg[0] != '-') options.scene = arg;
+        else return false;
+    }
+
+    // The wavefront queues hold WAVEFRONT_MAX_DEPTH bounces, deeper paths would be cut off without a trace
+    if (options.wavefront && options.maxDepth > WAVEFRONT_MAX_DEPTH)
+    {
+        GanymedePrint "--wavefront supports a --depth of at most", WAVEFRONT_MAX_DEPTH;
+        return false;
+    }
+
+    return !options.scene.empty() && options.size.x > 0 && options.size.y > 0 && options.spp > 0 && options.samplesPerFrame > 0 && options.maxDepth > 0;
+}
+
+// Amalthea's device setup without the present support check: the first device with a compute queue
+static bool CreateComputeDevice(Europa& europa, EuropaDevice::Ref& device, EuropaQueue::Ref& queue)
+{
+    for (EuropaDevice::Ref candidate : europa.GetDevices())
+    {
+        std::vector<EuropaQueueFamilyProperties> queueFamilies = candidate->GetQueueFamilies();
+        for (const EuropaQueueFamilyProperties& family : queueFamilies)
+        {
+            if (!family.compute) continue;
+
+            GanymedePrint "Device:", candidate->GetName();
+
+            float priority = 1.0f;
+            EuropaQueueCreateInfo queueInfo = { family, 1, &priority };
+            candidate->CreateLogicalDevice(1, &queueInfo);
+
+            device = candidate;
+            queue = candidate->GetQueue(family);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Checks a GPU built hierarchy against the CPU one of the same scene: every node reached once with consistent skip
+// links, children inside their parent, every triangle in exactly one leaf, the same root bounds, and the same closest
+// hits for numRays random rays through the scene bounds
+static bool ValidateGpuBVH(const std::vector<BVHNode>& nodes, const Scene& scene, uint32 numRays)
+{
+    uint32 numTriangles = scene.numIndices / 3;
+    std::vector<uint32> leafCount(numTriangles, 0);
+    uint32 errors = 0;
+    uint32 visited = 0;
+
+    auto inside = [](const BVHNode& child, const BVHNode& parent)
+    {
+        return glm::all(glm::greaterThanEqual(child.a, parent.a)) && glm::all(glm::lessThanEqual(child.b, parent.b));
+    };
+
+    struct Visit
+    {
+        int32 index;
+        int32 next;
+    };
+
+    std::vector<Visit> stack = { { 0, 0 } };
+    while (!stack.empty() && errors == 0)
+    {
+        Visit v = stack.back();
+        stack.pop_back();
+        visited++;
+
+        const BVHNode& node = nodes[v.index];
+        if (node.next != v.next) errors++;
+
+        if (node.right > 0)
+        {
+            if (node.right <= v.index + 1 || uint32(node.right) >= nodes.size()) { errors++; continue; }
+            if (!inside(nodes[v.index + 1], node) || !inside(nodes[node.right], node)) errors++;
+
+            stack.push_back({ v.index + 1, node.right });
+            stack.push_back({ node.right, v.next });
+        }
+        else
+        {
+            uint32 offset = uint32(-node.right);
+            if (offset % 3 != 0 || offset / 3 >= numTriangles) { errors++; continue; }
+            leafCount[offset / 3]++;
+        }
+    }
+
+    if (errors > 0 || visited != nodes.size())
+    {
+        GanymedePrint "GPU BVH: broken hierarchy,", visited, "of", nodes.size(), "nodes reached";
+        return false;
+    }
+
+    uint32 missing = uint32(std::count_if(leafCount.begin(), leafCount.end(), [](uint32 c) { return c != 1; }));
+    if (missing > 0)
+    {
+        GanymedePrint "GPU BVH:", missing, "triangles not in exactly one leaf";
+        return false;
+    }
+
+    const BVHNode& root = nodes[0];
+    const BVHNode& cpuRoot = scene.nodes[0];
+    float tolerance = 1e-5f * glm::length(cpuRoot.b - cpuRoot.a);
+    if (glm::any(glm::greaterThan(glm::abs(root.a - cpuRoot.a), glm::vec3(tolerance))) || glm::any(glm::greaterThan(glm::abs(root.b - cpuRoot.b), glm::vec3(tolerance))))
+    {
+        GanymedePrint "GPU BVH: root bounds differ from the CPU BVH";
+        return false;
+    }
+
+    std::vector<glm::vec4> vertices(scene.numVertices);
+    for (uint32 i = 0; i < scene.numVertices; i++) vertices[i] = glm::vec4(scene.positions[i], 1.0f);
+    std::vector<uint32> indices(scene.indices, scene.indices + scene.numIndices);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal;
+
+    uint32 mismatches = 0;
+    uint32 hits = 0;
+    TraceStats cpuStats, gpuStats;
+    for (uint32 i = 0; i < numRays; i++)
+    {
+        glm::vec3 o = glm::mix(cpuRoot.a, cpuRoot.b, glm::vec3(uniform(rng), uniform(rng), uniform(rng)));
+        glm::vec3 d = glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)));
+
+        Ray cpuRay(o, d, 0.0001f, 10000.0f);
+        Ray gpuRay = cpuRay;
+        Intersection cpuHit, gpuHit;
+        bool cpuResult = TraceRay(scene.nodes, vertices, indices, cpuRay, cpuHit, &cpuStats);
+        bool gpuResult = TraceRay(nodes, vertices, indices, gpuRay, gpuHit, &gpuStats);
+
+        if (cpuResult) hits++;
+        if (cpuResult != gpuResult || (cpuResult && std::abs(cpuRay.max_t - gpuRay.max_t) > 1e-5f * cpuRay.max_t)) mismatches++;
+    }
+
+    GanymedePrint "GPU BVH:", hits, "/", numRays, "rays hit,", mismatches, "differ from the CPU BVH, nodes visited per ray", double(gpuStats.nodesVisited) / numRays, "( CPU", double(cpuStats.nodesVisited) / numRays, ")";
+
+    return mismatches == 0;
+}
+
+// Readback buffer size, Europa's buffer sizes are 32 bit
+static const uint64 ReadbackBandBytes = 256ull << 20;
+
+static glm::vec3 ACESFilm(glm::vec3 x)
+{
+    float a = 2.51f;
+    float b = 0.03f;
+    float c = 2.43f;
+    float d = 0.59f;
+    float e = 0.14f;
+    return glm::clamp((x * (a * x + b)) / (x * (c * x + d) + e), glm::vec3(0.0f), glm::vec3(1.0f));
+}
+
+// pixels are the per pixel means, top row first
+static bool WriteImage(const std::string& file, glm::uvec2 size, const std::vector<glm::vec3>& pixels)
+{
+    std::ofstream stream(file, std::ofstream::binary);
+    if (!stream) return false;
+
+    if (file.size() >= 4 && file.compare(file.size() - 4, 4, ".pfm") == 0)
+    {
+        // Negative scale = little endian, rows are stored bottom to top
+        stream << "PF\n" << size.x << " " << size.y << "\n-1.0\n";
+        for (uint32 y = size.y; y-- > 0;)
+        {
+            stream.write((const char*)&pixels[y * size.x], size.x * sizeof(glm::vec3));
+        }
+    }
+    else
+    {
+        // Same tonemapping as composite.frag
+        stream << "P6\n" << size.x << " " << size.y << "\n255\n";
+        std::vector<uint8> row(size.x * 3);
+        for (uint32 y = 0; y < size.y; y++)
+        {
+            for (uint32 x = 0; x < size.x; x++)
+            {
+                glm::vec3 c = ACESFilm(pixels[y * size.x + x]);
+                for (uint32 k = 0; k < 3; k++) row[x * 3 + k] = uint8(std::pow(c[k], 1.0f / 2.2f) * 255.0f + 0.5f);
+            }
+            stream.write((const char*)row.data(), row.size());
+        }
+    }
+
+    return bool(stream);
+}
+
+int main(int argc, char** argv)
+{
+    HeadlessOptions options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        GanymedePrint "Usage: PathTracerHeadless scene.ply [--out render.pfm] [--size w h] [--tile w h] [--spp n] [--batch n] [--depth d] [--eye x y z] [--center x y z] [--ambient r g b] [--emissive threshold strength] [--no-sort] [--compact] [--persistent groups] [--wavefront] [--forward] [--gpu-bvh] [--validate-bvh] [--adaptive threshold] [--profile timings.csv]";
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    auto msSinceStart = [&]() { return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count() * 1000.0; };
+
+    float progress = 0.0f;
+    std::shared_ptr<Scene> scene = LoadScene(options.scene, BVHChildOrder::LargerFirst, progress);
+    if (scene->numIndices == 0)
+    {
+        GanymedePrint "No triangles in", options.scene;
+        return 1;
+    }
+
+    std::vector<Light> lights = scene->lights;
+    if (lights.empty()) lights.push_back({ glm::vec3(0.0, 1.4, 0.0), glm::vec3(1.0, 1.0, 1.0) });
+
+    std::vector<LightNode> lightTree = BuildLightTree(lights);
+    std::vector<AreaLight> areaLights;
+    if (options.emissiveTriangles)
+    {
+        areaLights = BuildAreaLights(scene->positions, scene->aux, scene->indices, scene->numIndices, options.emissiveThreshold, options.emissiveStrength);
+    }
+
+    GanymedePrint "Loaded", options.scene, "in", msSinceStart(), "ms,", scene->numIndices / 3, "triangles,", lights.size(), "lights,", areaLights.size(), "emissive triangles";
+
+    Europa& europa = EuropaVk();
+
+    EuropaDevice::Ref device;
+    EuropaQueue::Ref queue;
+    if (!CreateComputeDevice(europa, device, queue))
+    {
+        GanymedePrint "No Vulkan device with a compute queue";
+        return 1;
+    }
+
+    EuropaCmdPool::Ref cmdPool = device->CreateCommandPool(queue);
+    EuropaTransferUtil::Ref transfer = std::make_shared<EuropaTransferUtil>(device, queue, 16 * 1024 * 1024);
+
+    TraceSceneBuffers sceneBuffers;
+    UploadBlueNoise(device, transfer, sceneBuffers);
+    UploadSceneGeometry(device, transfer, *scene, sceneBuffers);
+    UploadLights(device, transfer, lights, lightTree, areaLights, sceneBuffers);
+
+    uint32 numBVHNodes = uint32(scene->nodes.size());
+    if (options.gpuBVH)
+    {
+        uint32 numTriangles = scene->numIndices / 3;
+
+        // Host visible when validating, so the nodes can be read back
+        GpuBVHBuilder bvhBuilder = CreateGpuBVHBuilder(device);
+        GpuBVHBuild bvhBuild = CreateGpuBVHBuild(device, bvhBuilder, sceneBuffers, numTriangles, options.validateBVH ? EuropaMemoryUsage::Gpu2Cpu : EuropaMemoryUsage::GpuOnly);
+
+        double buildStart = msSinceStart();
+
+        EuropaCmdlist::Ref cmdlist = cmdPool->AllocateCommandBuffer();
+        cmdlist->Begin();
+        RecordGpuBVHBuild(cmdlist, bvhBuilder, bvhBuild);
+        cmdlist->End();
+        queue->Submit(cmdlist);
+        queue->WaitIdle();
+
+        GanymedePrint "Built GPU BVH with", GpuBVHNodeCount(numTriangles), "nodes in", msSinceStart() - buildStart, "ms";
+
+        if (options.validateBVH)
+        {
+            BVHNode* mapped = bvhBuild.nodes->Map<BVHNode>();
+            std::vector<BVHNode> nodes(mapped, mapped + GpuBVHNodeCount(numTriangles));
+            bvhBuild.nodes->Unmap();
+
+            if (!ValidateGpuBVH(nodes, *scene, 4096)) return 1;
+        }
+
+        // The build's scratch buffers are released at the end of this scope
+        sceneBuffers.nodes = bvhBuild.nodes;
+        sceneBuffers.nodesSize = bvhBuild.nodesSize;
+        numBVHNodes = GpuBVHNodeCount(numTriangles);
+    }
+
+    TracePipelines pipelines = CreateTracePipelines(device);
+
+    // With --tile only the images are frame sized, the ray state is allocated for one tile
+    // The camera never moves, so no reprojection history
+    TraceTargets targets = CreateTraceTargets(device, options.size, options.maxDepth, options.forwardAccumulation, options.tileSize, options.samplesPerFrame, false);
+    if (!targets.accumulation) return 1;
+    std::vector<TraceTile> tiles = GetTraceTiles(targets);
+
+    if (tiles.size() > 1)
+    {
+        GanymedePrint "Rendering", tiles.size(), "tiles of", targets.tileSize.x, "x", targets.tileSize.y;
+    }
+
+    EuropaDescriptorPoolSizes descPoolSizes;
+    descPoolSizes.UniformDynamic = 1;
+    descPoolSizes.UniformTexel = 1;
+    descPoolSizes.StorageImage = 3;
+    descPoolSizes.Storage = 24;
+
+    EuropaDescriptorPool::Ref descPool = device->CreateDescriptorPool(descPoolSizes, 1);
+    EuropaDescriptorSet::Ref descSet = descPool->AllocateDescriptorSet(pipelines.descLayout);
+
+    TracePassOptions passOptions;
+    passOptions.raySort = options.raySort;
+    passOptions.compaction = options.compaction;
+    passOptions.persistentGroups = options.persistentGroups;
+    passOptions.wavefront = options.wavefront;
+    passOptions.constantsStride = alignUp(uint32(sizeof(ShaderConstants)), device->GetMinUniformBufferOffsetAlignment());
+
+    bool profiling = !options.profileLog.empty();
+    PassProfiler profiler;
+    if (profiling)
+    {
+        profiler = CreatePassProfiler(device, queue);
+        if (!OpenPassProfilerLog(profiler, options.profileLog))
+        {
+            GanymedePrint "Failed to open", options.profileLog;
+            return 1;
+        }
+        passOptions.passCallback = GetPassProfilerCallback(profiler);
+    }
+
+    // Per tile constants, with one copy per depth for the wavefront passes
+    uint32 numDepthCopies = GetTraceConstantCopies(targets, passOptions);
+
+    EuropaBufferInfo constantsInfo;
+    constantsInfo.exclusive = true;
+    constantsInfo.size = passOptions.constantsStride * numDepthCopies * uint32(tiles.size());
+    constantsInfo.usage = EuropaBufferUsageUniform;
+    constantsInfo.memoryUsage = EuropaMemoryUsage::Cpu2Gpu;
+    EuropaBuffer::Ref constantsBuffer = device->CreateBuffer(constantsInfo);
+
+    descSet->SetUniformBufferDynamic(constantsBuffer, 0, uint32(sizeof(ShaderConstants)), 0, 0);
+    SetTraceDescriptors(descSet, sceneBuffers, targets);
+
+    // The accumulation is read back in bands of whole rows, a 16K frame alone is 4 GiB
+    const uint64 rowBytes = uint64(options.size.x) * sizeof(glm::vec4);
+    const uint32 bandRows = uint32(std::max<uint64>(1, std::min<uint64>(options.size.y, ReadbackBandBytes / rowBytes)));
+
+    EuropaBufferInfo readbackInfo;
+    readbackInfo.exclusive = true;
+    readbackInfo.size = uint32(rowBytes * bandRows);
+    readbackInfo.usage = EuropaBufferUsageTransferDst;
+    readbackInfo.memoryUsage = EuropaMemoryUsage::Gpu2Cpu;
+    EuropaBuffer::Ref readback = device->CreateBuffer(readbackInfo);
+
+    glm::mat4 viewMtx = glm::lookAt(options.eye, options.center, glm::vec3(0.0, 1.0, 0.0));
+    glm::mat4 projMtx = glm::perspective(glm::radians(60.0f), float(options.size.x) / float(options.size.y), 0.01f, 256.0f);
+    projMtx[1].y = -projMtx[1].y;
+
+    double renderStart = msSinceStart();
+
+    uint32 numFrames = (options.spp + targets.samplesPerFrame - 1) / targets.samplesPerFrame;
+    uint32 spp = numFrames * targets.samplesPerFrame;
+
+    // One submission per frame of samplesPerFrame samples, the accumulation image is cleared before the first
+    for (uint32 frame = 0; frame < numFrames; frame++)
+    {
+        ShaderConstants constants = {};
+
+        constants.viewMtx = viewMtx;
+        constants.projMtx = projMtx;
+        constants.viewInvMtx = glm::inverse(viewMtx);
+        constants.projInvMtx = glm::inverse(projMtx);
+        constants.viewportSize = glm::vec2(options.size);
+        constants.numLights = uint32(lights.size());
+        constants.numTriangles = scene->numIndices / 3;
+        constants.frameIndex = (frame + 1) & 0xFFFF;
+        constants.numRays = options.maxDepth;
+        constants.numBVHNodes = numBVHNodes;
+        constants.ambientRadiance = options.ambientRadiance;
+        constants.numAreaLights = uint32(areaLights.size());
+        constants.forwardAccumulation = options.forwardAccumulation ? 1 : 0;
+        constants.convergenceThreshold = targets.convergenceMaskValid ? options.convergenceThreshold : 0.0f;
+
+        WriteTraceConstants(constantsBuffer->Map<uint8>(), passOptions.constantsStride, constants, tiles, numDepthCopies, targets.samplesPerFrame);
+        constantsBuffer->Unmap();
+
+        EuropaCmdlist::Ref cmdlist;
+        if (profiling)
+        {
+            cmdlist = BeginProfiledFrame(profiler);
+        }
+        else
+        {
+            cmdlist = cmdPool->AllocateCommandBuffer();
+            cmdlist->Begin();
+        }
+
+        if (frame == 0)
+        {
+            cmdlist->ClearImage(targets.accumulation, EuropaImageLayout::General, glm::vec4(0.0));
+            cmdlist->Barrier(
+                targets.accumulation,
+                EuropaAccessTransferWrite, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+                EuropaPipelineStageTransfer, EuropaPipelineStageComputeShader
+            );
+            if (profiling) EndProfiledPass(profiler, cmdlist, "clear", 0);
+        }
+
+        for (uint32 t = 0; t < tiles.size(); t++)
+        {
+            RecordTracePasses(cmdlist, pipelines, targets, descSet, tiles[t], t * numDepthCopies * passOptions.constantsStride, passOptions);
+        }
+
+        if (options.convergenceThreshold > 0.0f)
+        {
+            RecordConvergence(cmdlist, pipelines, targets, descSet, 0);
+            if (profiling) EndProfiledPass(profiler, cmdlist, "converge", 0);
+            targets.convergenceMaskValid = true;
+        }
+
+        if (frame == numFrames - 1)
+        {
+            cmdlist->Barrier(
+                targets.accumulation,
+                EuropaAccessShaderWrite, EuropaAccessTransferRead, EuropaImageLayout::General, EuropaImageLayout::TransferSrc,
+                EuropaPipelineStageComputeShader, EuropaPipelineStageTransfer
+            );
+        }
+
+        if (profiling)
+        {
+            EndProfiledFrame(profiler, cmdlist);
+        }
+        else
+        {
+            cmdlist->End();
+            queue->Submit(cmdlist);
+            queue->WaitIdle();
+        }
+
+        uint32 samples = (frame + 1) * targets.samplesPerFrame;
+        if ((frame + 1) % 16 == 0 || frame + 1 == numFrames)
+        {
+            GanymedePrint "Sample", samples, "/", spp, "(", (msSinceStart() - renderStart) / samples, "ms / sample )";
+        }
+    }
+
+    if (profiling)
+    {
+        GanymedePrint "Wall-clock pass times of the last frame (", profiler.submitOverheadMs, "ms submit overhead subtracted ), all frames in", options.profileLog;
+        for (const PassTiming& timing : profiler.lastFrame)
+        {
+            GanymedePrint " ", timing.pass, "depth", timing.depth, ":", timing.ms, "ms";
+        }
+    }
+
+    std::vector<glm::vec3> pixels(size_t(options.size.x) * options.size.y);
+    double totalSamples = 0.0;
+    for (uint32 y = 0; y < options.size.y; y += bandRows)
+    {
+        uint32 rows = std::min(bandRows, options.size.y - y);
+
+        EuropaCmdlist::Ref cmdlist = cmdPool->AllocateCommandBuffer();
+        cmdlist->Begin();
+        cmdlist->CopyImageToBuffer(
+            readback, targets.accumulation, EuropaImageLayout::TransferSrc,
+            0, options.size.x, rows,
+            glm::uvec3(0, y, 0), glm::uvec3(options.size.x, rows, 1), 0
+        );
+        cmdlist->End();
+        queue->Submit(cmdlist);
+        queue->WaitIdle();
+
+        glm::vec4* accumulation = readback->Map<glm::vec4>();
+        glm::vec3* band = pixels.data() + size_t(y) * options.size.x;
+        for (size_t i = 0; i < size_t(rows) * options.size.x; i++)
+        {
+            glm::vec4 acc = accumulation[i];
+            band[i] = acc.w > 0.0f ? glm::vec3(acc) / acc.w : glm::vec3(0.0f);
+            totalSamples += acc.w;
+        }
+        readback->Unmap();
+    }
+
+    if (options.convergenceThreshold > 0.0f)
+    {
+        GanymedePrint "Adaptive sampling:", totalSamples / double(pixels.size()), "mean spp";
+    }
+
+    if (!WriteImage(options.output, options.size, pixels))
+    {
+        GanymedePrint "Failed to write", options.output;
+        return 1;
+    }
+
+    GanymedePrint "Wrote", options.output, "(", options.size.x, "x", options.size.y, ",", spp, "spp ) in", msSinceStart(), "ms";
+
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "LightTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "BVH.h"
+
+std::vector<LightNode> BuildLightTree(const std::vector<Light>& lights)
+{
+    std::vector<LightNode> nodes;
+    if (lights.empty()) return nodes;
+
+    nodes.reserve(lights.size() * 2 - 1);
+
+    std::vector<uint32> order(lights.size());
+    for (uint32 i = 0; i < order.size(); i++) order[i] = i;
+
+    struct Task
+    {
+        uint32 start;
+        uint32 end;
+        uint32 node;
+    };
+
+    nodes.push_back({});
+    std::vector<Task> tasks = { { 0, uint32(lights.size()), 0 } };
+
+    while (!tasks.empty())
+    {
+        Task task = tasks.back();
+        tasks.pop_back();
+
+        BBox bbox;
+        float power = 0.0f;
+        for (uint32 i = task.start; i < task.end; i++)
+        {
+            bbox.Extend(lights[order[i]].pos);
+            power += std::max(Luminance(lights[order[i]].radiance), 0.0f);
+        }
+
+        LightNode& node = nodes[task.node];
+        node.a = bbox.a;
+        node.b = bbox.b;
+        node.power = power;
+
+        if (task.end - task.start == 1)
+        {
+            node.child = -int32(order[task.start]) - 1;
+            continue;
+        }
+
+        glm::vec3 size = bbox.GetSize();
+        int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+
+        uint32 center = (task.start + task.end) / 2;
+        std::nth_element(order.begin() + task.start, order.begin() + center, order.begin() + task.end, [&](uint32 l, uint32 r)
+        {
+            return lights[l].pos[axis] < lights[r].pos[axis];
+        });
+
+        uint32 child = uint32(nodes.size());
+        node.child = int32(child);
+
+        nodes.push_back({});
+        nodes.push_back({});
+
+        tasks.push_back({ task.start, center, child });
+        tasks.push_back({ center, task.end, child + 1 });
+    }
+
+    return nodes;
+}
+
+// Upper bound of the light falloff used in shading (1 / (dist^2 + 1)) over the node's bounds
+inline float LightNodeImportance(const LightNode& node, glm::vec3 p)
+{
+    glm::vec3 center = (node.a + node.b) * 0.5f;
+    float radius = glm::length(node.b - node.a) * 0.5f;
+    float dist = std::max(glm::length(p - center) - radius, 0.0f);
+    return node.power / (dist * dist + 1.0f);
+}
+
+int32 SampleLightTree(const std::vector<LightNode>& nodes, glm::vec3 p, float u, float& pmf)
+{
+    pmf = 0.0f;
+    if (nodes.empty()) return -1;
+
+    pmf = 1.0f;
+    uint32 index = 0;
+
+    while (nodes[index].child >= 0)
+    {
+        uint32 child = uint32(nodes[index].child);
+        float left = LightNodeImportance(nodes[child], p);
+        float right = LightNodeImportance(nodes[child + 1], p);
+        float pLeft = left + right > 0.0f ? left / (left + right) : 0.5f;
+
+        // Reuse u for the next level
+        if (u < pLeft)
+        {
+            u = u / pLeft;
+            pmf *= pLeft;
+            index = child;
+        }
+        else
+        {
+            u = (u - pLeft) / (1.0f - pLeft);
+            pmf *= 1.0f - pLeft;
+            index = child + 1;
+        }
+    }
+
+    return -nodes[index].child - 1;
+}
+
+std::vector<AreaLight> BuildAreaLights(const glm::vec3* positions, const PackedVertexAux* aux, const uint32* indices, uint32 numIndices, float threshold, float strength)
+{
+    std::vector<AreaLight> areaLights;
+
+    uint8 minColor = uint8(std::ceil(std::clamp(threshold, 0.0f, 1.0f) * 255.0f));
+
+    for (uint32 t = 0; t + 2 < numIndices; t += 3)
+    {
+        bool emissive = true;
+        glm::vec3 color(0.0f);
+        for (uint32 k = 0; k < 3; k++)
+        {
+            glm::u8vec4 c = aux[indices[t + k]].color;
+            emissive = emissive && c.r >= minColor && c.g >= minColor && c.b >= minColor && c.a >= 128;
+            color += glm::vec3(c.r, c.g, c.b) / (3.0f * 255.0f);
+        }
+
+        if (!emissive) continue;
+
+        AreaLight light = {};
+        light.p1 = positions[indices[t]];
+        light.p2 = positions[indices[t + 1]];
+        light.p3 = positions[indices[t + 2]];
+        light.area = 0.5f * glm::length(glm::cross(light.p2 - light.p1, light.p3 - light.p1));
+        // Same gamma as the albedo in shadeHit()
+        light.radiance = glm::vec3(std::pow(color.r, 2.2f), std::pow(color.g, 2.2f), std::pow(color.b, 2.2f)) * strength;
+
+        if (light.area > 0.0f) areaLights.push_back(light);
+    }
+
+    if (areaLights.empty()) return areaLights;
+
+    // Vose's alias method: every slot keeps its own triangle with aliasProb and defers to alias otherwise
+    uint32 n = uint32(areaLights.size());
+
+    double totalPower = 0.0;
+    for (const AreaLight& light : areaLights) totalPower += std::max(Luminance(light.radiance), 0.0f) * light.area;
+
+    std::vector<double> scaled(n);
+    std::vector<uint32> small, large;
+    for (uint32 i = 0; i < n; i++)
+    {
+        double power = std::max(Luminance(areaLights[i].radiance), 0.0f) * areaLights[i].area;
+        areaLights[i].pmf = totalPower > 0.0 ? float(power / totalPower) : 1.0f / n;
+        scaled[i] = totalPower > 0.0 ? power / totalPower * n : 1.0;
+        if (scaled[i] < 1.0) small.push_back(i);
+        else large.push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        uint32 s = small.back();
+        small.pop_back();
+        uint32 l = large.back();
+
+        areaLights[s].aliasProb = float(scaled[s]);
+        areaLights[s].alias = l;
+
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Leftovers are 1 up to rounding
+    small.insert(small.end(), large.begin(), large.end());
+    for (uint32 i : small)
+    {
+        areaLights[i].aliasProb = 1.0f;
+        areaLights[i].alias = i;
+    }
+
+    return areaLights;
+}
+
+int32 SampleAreaLight(const std::vector<AreaLight>& areaLights, float u, float& pmf)
+{
+    pmf = 0.0f;
+    if (areaLights.empty()) return -1;
+
+    float scaled = u * float(areaLights.size());
+    uint32 slot = std::min(uint32(scaled), uint32(areaLights.size() - 1));
+
+    uint32 index = (scaled - float(slot)) < areaLights[slot].aliasProb ? slot : areaLights[slot].alias;
+    pmf = areaLights[index].pmf;
+
+    return int32(index);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <vector>
+
+#include "ShaderData.h"
+
+// Light hierarchy for next event estimation, same 32 byte shape as BVHNode.
+// Inner nodes keep their children at child and child + 1, leaves store -(light index + 1) in child.
+// power is the summed luminance of the radiance below the node.
+struct LightNode
+{
+    glm::vec3 a;
+    float power;
+    glm::vec3 b;
+    int32 child;
+};
+
+// Triangle emitter for next event estimation, 64 bytes with the std430 layout of AreaLight in structures.glsl.
+// alias / aliasProb form a Walker alias table over the emitted power, pmf is the probability of picking this triangle.
+struct AreaLight
+{
+    glm::vec3 p1;
+    float area;
+    glm::vec3 p2;
+    uint32 alias;
+    glm::vec3 p3;
+    float aliasProb;
+    glm::vec3 radiance;
+    float pmf;
+};
+
+inline float Luminance(glm::vec3 c)
+{
+    return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+// Median split along the longest axis of the light positions, the root is node 0
+std::vector<LightNode> BuildLightTree(const std::vector<Light>& lights);
+
+// CPU mirror of sampleLightTree() in trace.comp: picks a light proportional to its estimated contribution at p,
+// returns -1 without lights
+int32 SampleLightTree(const std::vector<LightNode>& nodes, glm::vec3 p, float u, float& pmf);
+
+// Collects the triangles whose three vertices are opaque and have every color channel >= threshold as emitters with
+// radiance = linear color * strength, and builds the alias table over their power (luminance * area)
+std::vector<AreaLight> BuildAreaLights(const glm::vec3* positions, const PackedVertexAux* aux, const uint32* indices, uint32 numIndices, float threshold, float strength);
+
+// CPU mirror of sampleAreaLight() in trace.comp, returns -1 without area lights
+int32 SampleAreaLight(const std::vector<AreaLight>& areaLights, float u, float& pmf);
@@ -0,0 +1,90 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return;
+    }
+
+    m_data = (const uint8*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return;
+    }
+
+    m_size = size_t(size.QuadPart);
+    m_file = file;
+    m_mapping = mapping;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) UnmapViewOfFile(m_data);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return;
+
+    struct stat st;
+    if (fstat(file, &st) != 0 || st.st_size == 0)
+    {
+        close(file);
+        return;
+    }
+
+    void* data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED)
+    {
+        close(file);
+        return;
+    }
+
+    // The sections are parsed by several threads at once, let the kernel read ahead everywhere
+    madvise(data, size_t(st.st_size), MADV_WILLNEED);
+
+    m_data = (const uint8*)data;
+    m_size = size_t(st.st_size);
+    m_file = file;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) munmap((void*)m_data, m_size);
+    if (m_file >= 0) close(m_file);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return m_data != nullptr; }
+    const uint8* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    const uint8* m_data = nullptr;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+};
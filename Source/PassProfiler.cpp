@@ -0,0 +1,107 @@
+#include "PassProfiler.h"
+
+#include <algorithm>
+#include <limits>
+
+PassProfiler CreatePassProfiler(EuropaDevice::Ref device, EuropaQueue::Ref queue, uint32 interval)
+{
+    PassProfiler profiler;
+    profiler.queue = queue;
+    profiler.cmdPool = device->CreateCommandPool(queue);
+    profiler.interval = std::max(interval, 1u);
+    return profiler;
+}
+
+bool OpenPassProfilerLog(PassProfiler& profiler, const std::string& path)
+{
+    profiler.log.open(path, std::ios::out | std::ios::trunc);
+    if (!profiler.log.is_open()) return false;
+
+    profiler.log << "frame,pass,depth,wall_ms,submit_overhead_ms\n";
+    return true;
+}
+
+static EuropaCmdlist::Ref BeginCmdlist(PassProfiler& profiler)
+{
+    EuropaCmdlist::Ref cmdlist = profiler.cmdPool->AllocateCommandBuffer();
+    cmdlist->Begin();
+    return cmdlist;
+}
+
+static double SubmitAndWait(PassProfiler& profiler, EuropaCmdlist::Ref cmdlist)
+{
+    cmdlist->End();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    profiler.queue->Submit(cmdlist);
+    profiler.queue->WaitIdle();
+
+    return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count() * 1000.0;
+}
+
+// Fastest of a few empty submissions, the fixed cost every timed pass pays on top of its GPU time
+static double MeasureSubmitOverhead(PassProfiler& profiler)
+{
+    double overhead = std::numeric_limits<double>::max();
+    for (uint32 i = 0; i < 16; i++)
+    {
+        overhead = std::min(overhead, SubmitAndWait(profiler, BeginCmdlist(profiler)));
+    }
+    return overhead;
+}
+
+bool ProfileFrame(PassProfiler& profiler)
+{
+    return profiler.framesSeen++ % profiler.interval == 0;
+}
+
+EuropaCmdlist::Ref BeginProfiledFrame(PassProfiler& profiler)
+{
+    profiler.queue->WaitIdle();
+    profiler.timings.clear();
+
+    if (profiler.submitOverheadMs < 0.0)
+    {
+        profiler.submitOverheadMs = MeasureSubmitOverhead(profiler);
+        GanymedePrint "Pass profiler: empty submission takes", profiler.submitOverheadMs, "ms, subtracted from every pass";
+    }
+
+    return BeginCmdlist(profiler);
+}
+
+void EndProfiledPass(PassProfiler& profiler, EuropaCmdlist::Ref& cmdlist, const char* pass, uint32 depth)
+{
+    double ms = std::max(SubmitAndWait(profiler, cmdlist) - profiler.submitOverheadMs, 0.0);
+
+    auto timing = std::find_if(profiler.timings.begin(), profiler.timings.end(), [&](const PassTiming& t) { return t.pass == pass && t.depth == depth; });
+    if (timing != profiler.timings.end())
+        timing->ms += ms;
+    else
+        profiler.timings.push_back({ pass, depth, ms });
+
+    cmdlist = BeginCmdlist(profiler);
+}
+
+void EndProfiledFrame(PassProfiler& profiler, EuropaCmdlist::Ref cmdlist)
+{
+    SubmitAndWait(profiler, cmdlist);
+
+    if (profiler.log.is_open())
+    {
+        for (const PassTiming& timing : profiler.timings)
+        {
+            profiler.log << profiler.frame << "," << timing.pass << "," << timing.depth << "," << timing.ms << "," << profiler.submitOverheadMs << "\n";
+        }
+    }
+
+    profiler.lastFrame = profiler.timings;
+    profiler.frame++;
+}
+
+TracePassCallback GetPassProfilerCallback(PassProfiler& profiler)
+{
+    return [&profiler](EuropaCmdlist::Ref& cmdlist, const char* pass, uint32 depth)
+    {
+        EndProfiledPass(profiler, cmdlist, pass, depth);
+    };
+}
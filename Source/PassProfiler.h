@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Europa/Source/Europa.h"
+#include "Ganymede/Source/Ganymede.h"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "TracePasses.h"
+
+// Per pass wall-clock times without timestamp queries (Europa has no query pools yet): each pass is recorded into a command
+// list of its own, which is submitted and waited for before the next pass is recorded. The time from submit to idle is
+// the GPU time of the pass plus a submit / fence latency that is about the same for every pass, and that dominates small
+// passes. It is measured with empty submissions and subtracted, what is left is still a CPU side measurement.
+// Works on any Vulkan implementation, lavapipe included, but serializes the frames it times, so only one frame in
+// interval is timed (see ProfileFrame) and the others run as usual.
+
+struct PassTiming
+{
+    std::string pass;
+    uint32 depth = 0; // Path depth of the per depth passes
+    double ms = 0.0; // Wall-clock minus the submit overhead, summed over the tiles of the frame
+};
+
+struct PassProfiler
+{
+    EuropaQueue::Ref queue;
+    EuropaCmdPool::Ref cmdPool;
+
+    double submitOverheadMs = -1.0; // Of an empty submission, measured by the first BeginProfiledFrame
+
+    uint32 interval = 1; // Frames per timed frame
+    uint32 framesSeen = 0; // Counted by ProfileFrame
+
+    uint32 frame = 0; // Timed frames
+    std::vector<PassTiming> timings; // Of the current frame, in recording order
+    std::vector<PassTiming> lastFrame;
+
+    std::ofstream log; // CSV: frame,pass,depth,wall_ms,submit_overhead_ms
+};
+
+PassProfiler CreatePassProfiler(EuropaDevice::Ref device, EuropaQueue::Ref queue, uint32 interval = 1);
+
+// Starts writing every finished frame to a CSV file
+bool OpenPassProfilerLog(PassProfiler& profiler, const std::string& path);
+
+// Counts a frame, true for the one in interval frames that is timed
+bool ProfileFrame(PassProfiler& profiler);
+
+// Waits for all earlier work and returns the command list of the first pass
+EuropaCmdlist::Ref BeginProfiledFrame(PassProfiler& profiler);
+
+// Submits what was recorded since the last pass, times it as pass / depth and continues cmdlist in a new command list.
+// The new list has nothing bound.
+void EndProfiledPass(PassProfiler& profiler, EuropaCmdlist::Ref& cmdlist, const char* pass, uint32 depth);
+
+// Submits the rest of the frame untimed, profiler.lastFrame holds the frame's timings afterwards
+void EndProfiledFrame(PassProfiler& profiler, EuropaCmdlist::Ref cmdlist);
+
+// TracePassOptions::passCallback ending a pass of the profiler
+TracePassCallback GetPassProfilerCallback(PassProfiler& profiler);
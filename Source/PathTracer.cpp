@@ -6,19 +6,17 @@
 #include "Ganymede/Source/GanymedeECS.h"
 #include "Himalia/Source/Himalia.h"
 
-#include "trace.comp.h"
-#include "trace_speculative.comp.h"
-#include "launch.comp.h"
-#include "raysort.comp.h"
 #include "visualize.frag.h"
 #include "visualize.vert.h"
 #include "composite.frag.h"
 #include "composite.vert.h"
 
 #include <thread>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <fstream>
+#include <future>
 
 extern "C"
 {
@@ -28,23 +26,24 @@ extern "C"
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_precision.hpp>
 
-#include "blueNoise.h"
-
 #include "ShaderData.h"
 #include "BVH.h"
+#include "SceneCache.h"
+#include "LightTree.h"
+#include "TracePasses.h"
+#include "GpuBVH.h"
+#include "PassProfiler.h"
 
 #include "ImGuiExtensions.h"
 
-std::vector<glm::vec4> vertexPosition;
-std::vector<VertexAux> vertexAuxilary;
-std::vector<uint32> indices;
 std::vector<Light> lights = {
 	{ glm::vec3(0.0, 1.4, 0.0), glm::vec3(1.0, 1.0, 1.0) },
 };
-std::vector<BVHNode> nodes;
+std::vector<LightNode> lightTree;
+std::vector<AreaLight> areaLights;
 
-uint32 bvhVisStartVertex = 0;
-uint32 bvhVisStartIndex = 0;
+// The pass profiler times one frame in this many, the others keep running unserialized
+static const uint32 ProfileInterval = 16;
 
 class TestApp
 {
@@ -53,40 +52,38 @@ public:
 
 	// GFX data
 	struct {
-		EuropaBuffer::Ref m_vertexPosBuffer;
-		EuropaBufferView::Ref m_vertexPosBufferView;
-		EuropaBuffer::Ref m_vertexBuffer;
-		EuropaBuffer::Ref m_indexBuffer;
-		EuropaBufferView::Ref m_indexBufferView;
-		EuropaBuffer::Ref m_lightsBuffer;
-		EuropaBuffer::Ref m_blueNoiseBuffer;
-		EuropaBuffer::Ref m_bvhBuffer;
-		EuropaBuffer::Ref m_rayStackBuffer;
-		EuropaBuffer::Ref m_jobBuffer;
+		TraceSceneBuffers m_sceneBuffers;
+		TraceTargets m_targets;
+		TracePipelines m_tracePipelines;
+
+		GpuBVHBuilder m_bvhBuilder;
+		GpuBVHBuild m_gpuBVH;
+
+		PassProfiler m_profiler;
+
+		EuropaBuffer::Ref m_bvhVisVertexPosBuffer;
+		EuropaBuffer::Ref m_bvhVisVertexBuffer;
+		EuropaBuffer::Ref m_bvhVisIndexBuffer;
 
 		EuropaImage::Ref m_depthImage;
 		EuropaImageView::Ref m_depthView;
 
 		EuropaRenderPass::Ref m_mainRenderPass;
 
+		// Profiled frames draw the composite a second time into this, so it is timed without the swapchain image
+		EuropaRenderPass::Ref m_profileRenderPass;
+		EuropaImage::Ref m_profileTarget;
+		EuropaImageView::Ref m_profileTargetView;
+		EuropaFramebuffer::Ref m_profileFramebuffer;
+
 		EuropaDescriptorPool::Ref m_descPool;
-		EuropaPipeline::Ref m_pipeline;
-		EuropaPipeline::Ref m_pipelineSpeculative;
-		EuropaPipeline::Ref m_pipelineRayLaunch;
-		EuropaPipeline::Ref m_pipelineRaySort;
 		EuropaPipeline::Ref m_pipelineComposite;
 		EuropaPipeline::Ref m_pipelineVis;
 		EuropaPipeline::Ref m_pipelineVisLine;
-		EuropaPipelineLayout::Ref m_pipelineLayout;
 
 		std::vector<EuropaDescriptorSet::Ref> m_descSets;
 		std::vector<EuropaFramebuffer::Ref> m_frameBuffers;
 
-		EuropaImage::Ref m_accumulationImages;
-		EuropaImageView::Ref m_accumulationImageViews;
-		EuropaImage::Ref m_currentImage;
-		EuropaImageView::Ref m_currentImageView;
-
 		std::vector<EuropaBuffer::Ref> m_currentImageCpuBuffers;
 	};
 
@@ -97,21 +94,57 @@ public:
 		uint32 m_constantsSize;
 		bool m_visualize = false;
 		bool m_raySort = true;
+		bool m_compaction = false;
+		bool m_persistentThreads = false;
+		uint32 m_persistentGroups = 256;
+		bool m_wavefront = false;
+		bool m_forwardAccumulation = false;
+		uint32 m_samplesPerFrame = 1; // Paths per pixel per frame, amortizes the per pass overhead at low resolutions
+		bool m_reprojection = true; // Keep the accumulation through camera motion instead of clearing it
+		bool m_adaptiveSampling = false; // Stop sampling tiles whose relative error is below m_convergenceThreshold
+		float m_convergenceThreshold = 0.02f;
+		bool m_occluderFirstBVH = true;
+		bool m_gpuBVHBuild = false; // Trace with the LBVH built on the GPU instead of the CPU BVH
 		bool m_dumpData = false;
+		bool m_profilePasses = false; // Submit and time every pass of one frame in ProfileInterval on its own, see PassProfiler.h
 	};
 
 	// Scene parameters
 	struct {
 		bool sceneLoaded = false;
+		bool sceneLoadFailed = false;
 
 		std::string m_sceneFile = "../Models/cubeBinary.ply";
 
+		const std::vector<std::string> m_sceneList = {
+			"../Models/CBbunny.ply",
+			"../Models/CBdragon.ply",
+			"../Models/CBmonkey.ply",
+			"../Models/minecraft.ply",
+			"../Models/cornellBox.ply",
+			"../Models/sponza.ply",
+			"../Models/conference.ply",
+			"../Models/livingRoom.ply",
+			"../Models/SanMiguel.ply"
+		};
+
+		// Built scenes stay resident (up to 2 GB) so switching back is instant
+		SceneCache m_sceneCache = SceneCache(size_t(2) << 30);
+		std::shared_ptr<const Scene> m_scene;
+
 		glm::vec3 m_focusCenter = glm::vec3(0.0, 0.0, 0.0);
 		float m_orbitHeight = 0.5;
 		float m_orbitRadius = 3.0;
 		float m_orbitAngle = 0.0;
+		glm::mat4 m_prevViewMtx = glm::mat4(1.0f); // Camera of the last frame, for reprojection
+		glm::mat4 m_prevProjMtx = glm::mat4(1.0f);
 
 		glm::vec3 m_ambientRadiance = glm::vec3(0.4, 0.5, 0.7);
+
+		// Triangles with every vertex color channel >= threshold become area lights
+		bool m_emissiveTriangles = false;
+		float m_emissiveThreshold = 1.0f;
+		float m_emissiveStrength = 10.0f;
 	};
 
 	// Peformance trackers
@@ -121,18 +154,54 @@ public:
 		uint32 m_frameCount = 0;
 		float m_fps = 0.0;
 		float m_bvhBuildProgress = 0.0f;
+		std::vector<std::pair<std::string, GanymedeScrollingBuffer>> m_passTimeLogs; // Per pass and depth, in ms
+	};
+
+	// Scene load timeline (ms since the load started)
+	struct LoadStage
+	{
+		std::string name;
+		double start;
+		double end;
+	};
+
+	struct {
+		std::chrono::high_resolution_clock::time_point m_loadStart;
+		std::vector<LoadStage> m_loadTimeline;
+		std::mutex m_loadTimelineLock;
+		bool m_firstFrameRendered = false;
 	};
 
-	void UpdateLights()
+	double MsSinceLoadStart()
+	{
+		return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - m_loadStart).count() * 1000.0;
+	}
+
+	template <typename Func>
+	void LoadStep(const char* name, Func func)
+	{
+		double start = MsSinceLoadStart();
+		func();
+		double end = MsSinceLoadStart();
+
+		std::lock_guard<std::mutex> lk(m_loadTimelineLock);
+		m_loadTimeline.push_back({ name, start, end });
+	}
+
+	// scene is m_scene, except while loading when the geometry is uploaded ahead of the rest of the scene
+	void UpdateLights(const Scene* scene = nullptr)
 	{
-		EuropaBufferInfo lightBufferInfo;
-		lightBufferInfo.exclusive = true;
-		lightBufferInfo.size = uint32(lights.size() * sizeof(Light));
-		lightBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst);
-		lightBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-		m_lightsBuffer = m_amalthea.m_device->CreateBuffer(lightBufferInfo);
-
-		m_amalthea.m_transferUtil->UploadToBufferEx(m_lightsBuffer, lights.data(), uint32(lights.size()));
+		if (!scene) scene = m_scene.get();
+
+		lightTree = BuildLightTree(lights);
+
+		areaLights.clear();
+		if (m_emissiveTriangles && scene)
+		{
+			areaLights = BuildAreaLights(scene->positions, scene->aux, scene->indices, scene->numIndices, m_emissiveThreshold, m_emissiveStrength);
+		}
+
+		UploadLights(m_amalthea.m_device, m_amalthea.m_transferUtil, lights, lightTree, areaLights, m_sceneBuffers);
 	}
 
 	// Write-out related data / structures
@@ -239,88 +308,128 @@ public:
 	AmaltheaBehaviors::OnCreateDevice f_onCreateDevice = [&](Amalthea* amalthea)
 	{
 		m_bvhBuildProgress = 0.0f;
+		sceneLoadFailed = false;
+
+		m_loadStart = std::chrono::high_resolution_clock::now();
+		m_loadTimeline.clear();
+		m_firstFrameRendered = false;
 
 		// ASYNC loading
+		// The loading thread gets the scene from the cache (loading it on a miss), a second thread does the uploads:
+		//   loading:  scene cache -> parse PLY, build BVH, reorder & pack vertices, BVH visualization (or map .ptscene)
+		//   upload:   blue noise (overlaps the scene load) -> lights, vertices, indices & BVH (as soon as the reorder is done,
+		//             overlapping the BVH visualization) -> BVH visualization
+		// Pipelines are created by f_onCreateSwapChain meanwhile, the compute ones on worker threads.
 		std::thread loading_thread([&](Amalthea* amalthea) {
-			// Load Model
-			HimaliaPlyModel plyModel;
+			// Set by the scene cache once the geometry is final, nullptr when the scene failed before that
+			std::promise<std::shared_ptr<const Scene>> geometryReady;
+			std::future<std::shared_ptr<const Scene>> geometryReadyFuture = geometryReady.get_future();
+			bool geometrySignalled = false;
 
-			plyModel.LoadFile(m_sceneFile);
+			std::promise<void> sceneReady;
+			std::shared_future<void> sceneReadyFuture = sceneReady.get_future();
 
-			HimaliaVertexProperty vertexFormatAux[] = {
-				HimaliaVertexProperty::Normal,
-				HimaliaVertexProperty::ColorRGBA8
-			};
-			uint32 alignments[] = {
-				0, offsetof(VertexAux, VertexAux::color)
-			};
-			plyModel.mesh.BuildVertices<VertexAux>(vertexAuxilary, 2, vertexFormatAux, alignments);
+			std::thread upload_thread([&]() {
+				LoadStep("Upload blue noise", [&]() {
+					UploadBlueNoise(amalthea->m_device, amalthea->m_transferUtil, m_sceneBuffers);
+				});
 
-			HimaliaVertexProperty vertexFormat = HimaliaVertexProperty::Position;
-			plyModel.mesh.BuildVertices<glm::vec4>(vertexPosition, 1, &vertexFormat);
+				std::shared_ptr<const Scene> geometry = geometryReadyFuture.get();
+				if (!geometry) return;
 
-			plyModel.mesh.BuildIndices<uint32>(indices);
+				LoadStep("Upload lights", [&]() {
+					UpdateLights(geometry.get());
+				});
 
-			bvhVisStartIndex = uint32(indices.size());
-			bvhVisStartVertex = uint32(vertexPosition.size());
+				LoadStep("Upload vertices, indices & BVH", [&]() {
+					UploadSceneGeometry(amalthea->m_device, amalthea->m_transferUtil, *geometry, m_sceneBuffers);
 
-			nodes = BuildBVH(vertexPosition, indices, m_bvhBuildProgress);
+					GanymedePrint "Vertex buffers:", geometry->numVertices * (sizeof(glm::vec3) + sizeof(PackedVertexAux)) / 1024, "KB (", geometry->numVertices * (sizeof(glm::vec4) + sizeof(VertexAux)) / 1024, "KB unpacked )";
+				});
 
-			VisualizeBVH(nodes, vertexPosition, vertexAuxilary, indices);
+				sceneReadyFuture.wait();
+				if (!m_scene) return;
 
-			// Create & Upload geometry buffers
-			EuropaBufferInfo vertexBufferInfo;
-			vertexBufferInfo.exclusive = true;
-			vertexBufferInfo.size = uint32(vertexAuxilary.size() * sizeof(VertexAux));
-			vertexBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageVertex | EuropaBufferUsageTransferDst);
-			vertexBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-			m_vertexBuffer = amalthea->m_device->CreateBuffer(vertexBufferInfo);
+				const Scene& scene = *m_scene;
 
-			amalthea->m_transferUtil->UploadToBufferEx(m_vertexBuffer, vertexAuxilary.data(), uint32(vertexAuxilary.size()));
+				LoadStep("Upload BVH visualization", [&]() {
+					m_bvhVisVertexBuffer = CreateGpuBuffer(amalthea->m_device, uint32(scene.visAux.size() * sizeof(PackedVertexAux)), EuropaBufferUsage(EuropaBufferUsageVertex | EuropaBufferUsageTransferDst));
+					amalthea->m_transferUtil->UploadToBufferEx(m_bvhVisVertexBuffer, scene.visAux.data(), uint32(scene.visAux.size()));
 
-			EuropaBufferInfo vertexBufferPosInfo;
-			vertexBufferPosInfo.exclusive = true;
-			vertexBufferPosInfo.size = uint32(vertexPosition.size() * sizeof(glm::vec4));
-			vertexBufferPosInfo.usage = EuropaBufferUsage(EuropaBufferUsageUniformTexel | EuropaBufferUsageVertex | EuropaBufferUsageTransferDst);
-			vertexBufferPosInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-			m_vertexPosBuffer = amalthea->m_device->CreateBuffer(vertexBufferPosInfo);
+					m_bvhVisVertexPosBuffer = CreateGpuBuffer(amalthea->m_device, uint32(scene.visPositions.size() * sizeof(glm::vec3)), EuropaBufferUsage(EuropaBufferUsageVertex | EuropaBufferUsageTransferDst));
+					amalthea->m_transferUtil->UploadToBufferEx(m_bvhVisVertexPosBuffer, scene.visPositions.data(), uint32(scene.visPositions.size()));
 
-			amalthea->m_transferUtil->UploadToBufferEx(m_vertexPosBuffer, vertexPosition.data(), uint32(vertexPosition.size()));
+					m_bvhVisIndexBuffer = CreateGpuBuffer(amalthea->m_device, uint32(scene.visIndices.size() * sizeof(uint32)), EuropaBufferUsage(EuropaBufferUsageIndex | EuropaBufferUsageTransferDst));
+					amalthea->m_transferUtil->UploadToBufferEx(m_bvhVisIndexBuffer, scene.visIndices.data(), uint32(scene.visIndices.size()));
+				});
+			});
 
-			m_vertexPosBufferView = amalthea->m_device->CreateBufferView(m_vertexPosBuffer, vertexBufferPosInfo.size, 0, EuropaImageFormat::RGBA32F);
+			BVHChildOrder order = m_occluderFirstBVH ? BVHChildOrder::LargerFirst : BVHChildOrder::Split;
+			bool cacheHit = false;
+			double sceneStart = MsSinceLoadStart();
+
+			m_scene = m_sceneCache.Get(m_sceneFile, order, m_bvhBuildProgress, &cacheHit, [&](std::shared_ptr<const Scene> scene) {
+				if (!scene->lights.empty())
+				{
+					lights = scene->lights;
+				}
 
-			EuropaBufferInfo indexBufferInfo;
-			indexBufferInfo.exclusive = true;
-			indexBufferInfo.size = uint32(indices.size() * sizeof(uint32));
-			indexBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageUniformTexel | EuropaBufferUsageIndex | EuropaBufferUsageTransferDst);
-			indexBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-			m_indexBuffer = amalthea->m_device->CreateBuffer(indexBufferInfo);
+				geometrySignalled = true;
+				geometryReady.set_value(scene);
+			});
 
-			m_indexBufferView = amalthea->m_device->CreateBufferView(m_indexBuffer, uint32(bvhVisStartIndex * sizeof(uint32)), 0, EuropaImageFormat::RGB32UI);
+			if (!geometrySignalled) geometryReady.set_value(nullptr);
 
-			amalthea->m_transferUtil->UploadToBufferEx(m_indexBuffer, indices.data(), uint32(indices.size()));
+			// The loading screen offers the other scenes of the list instead
+			if (!m_scene)
+			{
+				sceneLoadFailed = true;
+				sceneReady.set_value();
+				upload_thread.join();
+				return;
+			}
 
-			UpdateLights();
+			{
+				std::lock_guard<std::mutex> lk(m_loadTimelineLock);
+				if (cacheHit)
+				{
+					m_loadTimeline.push_back({ "Scene cache hit", sceneStart, MsSinceLoadStart() });
+				}
+				else
+				{
+					// May have waited on a running prefetch, so the steps are laid out back to back from the end
+					double end = MsSinceLoadStart();
+					double start = end;
+					for (const auto& step : m_scene->stages) start -= step.second;
+					for (const auto& step : m_scene->stages)
+					{
+						m_loadTimeline.push_back({ step.first, start, start + step.second });
+						start += step.second;
+					}
+				}
+			}
 
-			EuropaBufferInfo blueNoiseBufferInfo;
-			blueNoiseBufferInfo.exclusive = true;
-			blueNoiseBufferInfo.size = sizeof(_blueNoise);
-			blueNoiseBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst);
-			blueNoiseBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-			m_blueNoiseBuffer = amalthea->m_device->CreateBuffer(blueNoiseBufferInfo);
+			sceneReady.set_value();
 
-			amalthea->m_transferUtil->UploadToBufferEx(m_blueNoiseBuffer, _blueNoise, sizeof(_blueNoise) / sizeof(uint16));
+			upload_thread.join();
 
-			EuropaBufferInfo bvhBufferInfo;
-			bvhBufferInfo.exclusive = true;
-			bvhBufferInfo.size = uint32(nodes.size() * sizeof(BVHNode));
-			bvhBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst);
-			bvhBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-			m_bvhBuffer = amalthea->m_device->CreateBuffer(bvhBufferInfo);
+			{
+				std::lock_guard<std::mutex> lk(m_loadTimelineLock);
+				for (const LoadStage& stage : m_loadTimeline)
+				{
+					GanymedePrint stage.name, ":", stage.start, "->", stage.end, "ms (", stage.end - stage.start, "ms )";
+				}
+			}
 
-			amalthea->m_transferUtil->UploadToBufferEx(m_bvhBuffer, nodes.data(), uint32(nodes.size()));
-		
 			sceneLoaded = true;
+
+			// Get the neighbours in the scene list ready in the background
+			auto current = std::find(m_sceneList.begin(), m_sceneList.end(), m_sceneFile);
+			if (current != m_sceneList.end())
+			{
+				if (current + 1 != m_sceneList.end()) m_sceneCache.Prefetch(*(current + 1), order);
+				if (current != m_sceneList.begin()) m_sceneCache.Prefetch(*(current - 1), order);
+			}
 		}, amalthea);
 
 		loading_thread.detach();
@@ -333,13 +442,101 @@ public:
 
 	AmaltheaBehaviors::OnDestroyDevice f_onDestroyDevice = [&](Amalthea* amalthea)
 	{
-		vertexPosition.clear(); vertexPosition.shrink_to_fit();
-		vertexAuxilary.clear(); vertexAuxilary.shrink_to_fit();
-		indices.clear(); indices.shrink_to_fit();
+		// The CPU side stays in the scene cache
+		m_scene.reset();
+		m_gpuBVH = {};
 
 		sceneLoaded = false;
 	};
 
+	// Color target in finalLayout, cleared depth
+	EuropaRenderPass::Ref CreateMainRenderPass(EuropaDevice::Ref device, EuropaImageLayout finalLayout)
+	{
+		EuropaRenderPass::Ref renderPass = device->CreateRenderPassBuilder();
+		uint32 presentTarget = renderPass->AddAttachment(EuropaAttachmentInfo{
+			EuropaImageFormat::BGRA8sRGB,
+			EuropaAttachmentLoadOp::Clear,
+			EuropaAttachmentStoreOp::Store,
+			EuropaAttachmentLoadOp::DontCare,
+			EuropaAttachmentStoreOp::DontCare,
+			EuropaImageLayout::Undefined,
+			finalLayout
+			});
+		uint32 depthTarget = renderPass->AddAttachment(EuropaAttachmentInfo{
+			EuropaImageFormat::D16Unorm,
+			EuropaAttachmentLoadOp::Clear,
+			EuropaAttachmentStoreOp::Store,
+			EuropaAttachmentLoadOp::DontCare,
+			EuropaAttachmentStoreOp::DontCare,
+			EuropaImageLayout::Undefined,
+			EuropaImageLayout::DepthStencilAttachment
+			});
+		EuropaAttachmentReference depthAttachment = { depthTarget, EuropaImageLayout::DepthStencilAttachment };
+		std::vector<EuropaAttachmentReference> attachmentsForward = {
+			{ presentTarget, EuropaImageLayout::ColorAttachment }
+		};
+		uint32 forwardPass = renderPass->AddSubpass(EuropaPipelineBindPoint::Graphics, attachmentsForward, &depthAttachment);
+		renderPass->AddDependency(EuropaRenderPass::SubpassExternal, forwardPass, EuropaPipelineStageBottomOfPipe, EuropaAccessNone, EuropaPipelineStageFragmentShader, EuropaAccessColorAttachmentWrite);
+		renderPass->CreateRenderpass();
+		return renderPass;
+	}
+
+	// Swapchain sized stand in for the swapchain image, created by the first profiled frame.
+	// The render pass is compatible with m_mainRenderPass, so the composite pipeline draws into it as well.
+	void CreateProfileTarget(Amalthea* amalthea)
+	{
+		m_profileRenderPass = CreateMainRenderPass(amalthea->m_device, EuropaImageLayout::ColorAttachment);
+
+		EuropaImageInfo info;
+		info.width = amalthea->m_windowSize.x;
+		info.height = amalthea->m_windowSize.y;
+		info.initialLayout = EuropaImageLayout::Undefined;
+		info.type = EuropaImageType::Image2D;
+		info.format = EuropaImageFormat::BGRA8sRGB;
+		info.usage = EuropaImageUsageColorAttachment;
+		info.memoryUsage = EuropaMemoryUsage::GpuOnly;
+
+		m_profileTarget = amalthea->m_device->CreateImage(info);
+
+		EuropaImageViewCreateInfo viewInfo;
+		viewInfo.format = EuropaImageFormat::BGRA8sRGB;
+		viewInfo.image = m_profileTarget;
+		viewInfo.type = EuropaImageViewType::View2D;
+		viewInfo.minArrayLayer = 0;
+		viewInfo.minMipLevel = 0;
+		viewInfo.numArrayLayers = 1;
+		viewInfo.numMipLevels = 1;
+
+		m_profileTargetView = amalthea->m_device->CreateImageView(viewInfo);
+
+		EuropaFramebufferCreateInfo desc;
+		desc.attachments = { m_profileTargetView, m_depthView };
+		desc.width = amalthea->m_windowSize.x;
+		desc.height = amalthea->m_windowSize.y;
+		desc.layers = 1;
+		desc.renderpass = m_profileRenderPass;
+
+		m_profileFramebuffer = amalthea->m_device->CreateFramebuffer(desc);
+	}
+
+	// Adds the pass times of the last profiled frame to the Passes plot
+	void LogPassTimes(float time)
+	{
+		for (const PassTiming& timing : m_profiler.lastFrame)
+		{
+			std::string label = timing.pass + " " + std::to_string(timing.depth);
+
+			auto log = std::find_if(m_passTimeLogs.begin(), m_passTimeLogs.end(), [&](const auto& l) { return l.first == label; });
+			if (log == m_passTimeLogs.end())
+			{
+				m_passTimeLogs.push_back({ label, GanymedeScrollingBuffer(1000, 0) });
+				log = m_passTimeLogs.end() - 1;
+			}
+
+			log->second.AddPoint(time, float(timing.ms));
+		}
+	}
+
 	void ReloadScene()
 	{
 		f_onDestroyDevice(&m_amalthea);
@@ -352,6 +549,8 @@ public:
 
 	AmaltheaBehaviors::OnCreateSwapChain f_onCreateSwapChain = [&](Amalthea* amalthea)
 	{
+		auto swapChainStart = std::chrono::high_resolution_clock::now();
+
 		// Create Depth buffer
 		EuropaImageInfo depthInfo;
 		depthInfo.width = amalthea->m_windowSize.x;
@@ -375,61 +574,10 @@ public:
 
 		m_depthView = amalthea->m_device->CreateImageView(depthViewInfo);
 
-		// Create Accumulation buffer
-		m_accumulationImages = nullptr;
-		m_accumulationImageViews = nullptr;
-
-		{
-			EuropaImageInfo info;
-			info.width = m_amalthea.m_windowSize.x;
-			info.height = m_amalthea.m_windowSize.y;
-			info.initialLayout = EuropaImageLayout::General;
-			info.type = EuropaImageType::Image2D;
-			info.format = EuropaImageFormat::RGBA32F;
-			info.usage = EuropaImageUsage(EuropaImageUsageStorage | EuropaImageUsageTransferSrc | EuropaImageUsageTransferDst);
-			info.memoryUsage = EuropaMemoryUsage::GpuOnly;
-
-			m_accumulationImages = m_amalthea.m_device->CreateImage(info);
-
-			EuropaImageViewCreateInfo viewInfo;
-			viewInfo.format = EuropaImageFormat::RGBA32F;
-			viewInfo.image = m_accumulationImages;
-			viewInfo.type = EuropaImageViewType::View2D;
-			viewInfo.minArrayLayer = 0;
-			viewInfo.minMipLevel = 0;
-			viewInfo.numArrayLayers = 1;
-			viewInfo.numMipLevels = 1;
-
-			m_accumulationImageViews = m_amalthea.m_device->CreateImageView(viewInfo);
-		}
-
-		// Create Current Sampled Image
-		m_currentImage = nullptr;
-		m_currentImageView = nullptr;
+		// Create accumulation / current images, ray stack, job buffer and occluder cache
+		m_targets = CreateTraceTargets(amalthea->m_device, glm::uvec2(amalthea->m_windowSize), m_maxDepth, m_forwardAccumulation, glm::uvec2(0), m_samplesPerFrame);
 
 		{
-			EuropaImageInfo info;
-			info.width = m_amalthea.m_windowSize.x;
-			info.height = m_amalthea.m_windowSize.y;
-			info.initialLayout = EuropaImageLayout::General;
-			info.type = EuropaImageType::Image2D;
-			info.format = EuropaImageFormat::RGBA16F;
-			info.usage = EuropaImageUsage(EuropaImageUsageStorage | EuropaImageUsageTransferSrc | EuropaImageUsageTransferDst);
-			info.memoryUsage = EuropaMemoryUsage::GpuOnly;
-
-			m_currentImage = m_amalthea.m_device->CreateImage(info);
-
-			EuropaImageViewCreateInfo viewInfo;
-			viewInfo.format = EuropaImageFormat::RGBA16F;
-			viewInfo.image = m_currentImage;
-			viewInfo.type = EuropaImageViewType::View2D;
-			viewInfo.minArrayLayer = 0;
-			viewInfo.minMipLevel = 0;
-			viewInfo.numArrayLayers = 1;
-			viewInfo.numMipLevels = 1;
-
-			m_currentImageView = m_amalthea.m_device->CreateImageView(viewInfo);
-
 			EuropaBufferInfo cpuBufferInfo;
 			cpuBufferInfo.exclusive = true;
 			cpuBufferInfo.size = uint32(m_amalthea.m_windowSize.x * m_amalthea.m_windowSize.y * sizeof(glm::u16vec4));
@@ -442,97 +590,22 @@ public:
 			}
 		}
 
-		// Create Ray Stack
-		EuropaBufferInfo rayStackInfo;
-		rayStackInfo.exclusive = true;
-		rayStackInfo.size = uint32(m_amalthea.m_windowSize.x * m_amalthea.m_windowSize.y * 5 * sizeof(RayStack));
-		rayStackInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferSrc);
-		rayStackInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-		m_rayStackBuffer = m_amalthea.m_device->CreateBuffer(rayStackInfo);
-
-		// Create Job Buffer
-		EuropaBufferInfo jobBufferInfo;
-		jobBufferInfo.exclusive = true;
-		jobBufferInfo.size = uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * sizeof(RayJob));
-		jobBufferInfo.usage = EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferSrc);
-		jobBufferInfo.memoryUsage = EuropaMemoryUsage::GpuOnly;
-		m_jobBuffer = amalthea->m_device->CreateBuffer(jobBufferInfo);
-
 		// Create Renderpass
-		m_mainRenderPass = amalthea->m_device->CreateRenderPassBuilder();
-		uint32 presentTarget = m_mainRenderPass->AddAttachment(EuropaAttachmentInfo{
-			EuropaImageFormat::BGRA8sRGB,
-			EuropaAttachmentLoadOp::Clear,
-			EuropaAttachmentStoreOp::Store,
-			EuropaAttachmentLoadOp::DontCare,
-			EuropaAttachmentStoreOp::DontCare,
-			EuropaImageLayout::Undefined,
-			EuropaImageLayout::Present
-			});
-		uint32 depthTarget = m_mainRenderPass->AddAttachment(EuropaAttachmentInfo{
-			EuropaImageFormat::D16Unorm,
-			EuropaAttachmentLoadOp::Clear,
-			EuropaAttachmentStoreOp::Store,
-			EuropaAttachmentLoadOp::DontCare,
-			EuropaAttachmentStoreOp::DontCare,
-			EuropaImageLayout::Undefined,
-			EuropaImageLayout::DepthStencilAttachment
-			});
-		EuropaAttachmentReference depthAttachment = { depthTarget, EuropaImageLayout::DepthStencilAttachment };
-		std::vector<EuropaAttachmentReference> attachmentsForward = {
-			{ presentTarget, EuropaImageLayout::ColorAttachment }
-		};
-		uint32 forwardPass = m_mainRenderPass->AddSubpass(EuropaPipelineBindPoint::Graphics, attachmentsForward, &depthAttachment);
-		m_mainRenderPass->AddDependency(EuropaRenderPass::SubpassExternal, forwardPass, EuropaPipelineStageBottomOfPipe, EuropaAccessNone, EuropaPipelineStageFragmentShader, EuropaAccessColorAttachmentWrite);
-		m_mainRenderPass->CreateRenderpass();
-
-		// Create Pipeline
-		EuropaDescriptorSetLayout::Ref descLayout = amalthea->m_device->CreateDescriptorSetLayout();
-		descLayout->DynamicUniformBuffer(0, 1, EuropaShaderStageAll);
-		descLayout->Storage(1, 1, EuropaShaderStageCompute);
-		descLayout->Storage(2, 1, EuropaShaderStageCompute);
-		descLayout->BufferViewUniform(3, 1, EuropaShaderStageCompute);
-		descLayout->Storage(4, 1, EuropaShaderStageCompute);
-		descLayout->ImageViewStorage(5, 1, EuropaShaderStageAll);
-		descLayout->ImageViewStorage(6, 1, EuropaShaderStageAll);
-		descLayout->BufferViewUniform(7, 1, EuropaShaderStageCompute);
-		descLayout->Storage(8, 1, EuropaShaderStageCompute);
-		descLayout->Storage(9, 1, EuropaShaderStageAll);
-		descLayout->Storage(10, 1, EuropaShaderStageCompute);
-		descLayout->Build();
-
-		m_pipelineLayout = amalthea->m_device->CreatePipelineLayout(EuropaPipelineLayoutInfo{ 1, 0, &descLayout });
-
-		{
-			EuropaShaderModule::Ref shader = amalthea->m_device->CreateShaderModule(shader_spv_trace_comp_h, sizeof(shader_spv_trace_comp_h));
-
-			EuropaShaderStageInfo stage = { EuropaShaderStageCompute, shader, "main" };
-
-			m_pipeline = amalthea->m_device->CreateComputePipeline(stage, m_pipelineLayout);
-		}
-
-		{
-			EuropaShaderModule::Ref shader = amalthea->m_device->CreateShaderModule(shader_spv_trace_speculative_comp_h, sizeof(shader_spv_trace_speculative_comp_h));
-
-			EuropaShaderStageInfo stage = { EuropaShaderStageCompute, shader, "main" };
-
-			m_pipelineSpeculative = amalthea->m_device->CreateComputePipeline(stage, m_pipelineLayout);
-		}
+		m_mainRenderPass = CreateMainRenderPass(amalthea->m_device, EuropaImageLayout::Present);
 
+		// Create Pipelines
+		// The compute pipelines don't depend on the swapchain, they are created with the first one and kept on resize.
+		// Their shaders compile on a thread pool, see ComputePipelineBatch.
+		if (!m_tracePipelines.layout)
 		{
-			EuropaShaderModule::Ref shader = amalthea->m_device->CreateShaderModule(shader_spv_launch_comp_h, sizeof(shader_spv_launch_comp_h));
+			auto pipelinesStart = std::chrono::high_resolution_clock::now();
 
-			EuropaShaderStageInfo stage = { EuropaShaderStageCompute, shader, "main" };
+			m_bvhBuilder = CreateGpuBVHBuilder(amalthea->m_device);
+			m_tracePipelines = CreateTracePipelines(amalthea->m_device);
 
-			m_pipelineRayLaunch = amalthea->m_device->CreateComputePipeline(stage, m_pipelineLayout);
-		}
+			m_profiler = CreatePassProfiler(amalthea->m_device, amalthea->m_cmdQueue, ProfileInterval);
 
-		{
-			EuropaShaderModule::Ref shader = amalthea->m_device->CreateShaderModule(shader_spv_raysort_comp_h, sizeof(shader_spv_raysort_comp_h));
-
-			EuropaShaderStageInfo stage = { EuropaShaderStageCompute, shader, "main" };
-
-			m_pipelineRaySort = amalthea->m_device->CreateComputePipeline(stage, m_pipelineLayout);
+			GanymedePrint "Created compute pipelines in", std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - pipelinesStart).count() * 1000.0, "ms";
 		}
 
 		{
@@ -561,7 +634,7 @@ public:
 			pipelineDesc.scissor.size = amalthea->m_windowSize;
 			pipelineDesc.depthStencil.enableDepthTest = false;
 			pipelineDesc.depthStencil.enableDepthWrite = false;
-			pipelineDesc.layout = m_pipelineLayout;
+			pipelineDesc.layout = m_tracePipelines.layout;
 			pipelineDesc.renderpass = m_mainRenderPass;
 			pipelineDesc.targetSubpass = forwardPass;
 
@@ -581,11 +654,11 @@ public:
 
 			EuropaVertexInputBindingInfo binding[2];
 			binding[0].binding = 0;
-			binding[0].stride = sizeof(glm::vec4);
+			binding[0].stride = sizeof(glm::vec3);
 			binding[0].perInstance = false;
 
 			binding[1].binding = 1;
-			binding[1].stride = sizeof(VertexAux);
+			binding[1].stride = sizeof(PackedVertexAux);
 			binding[1].perInstance = false;
 
 			EuropaVertexAttributeBindingInfo attributes[3];
@@ -596,13 +669,13 @@ public:
 
 			attributes[1].binding = 1;
 			attributes[1].location = 1;
-			attributes[1].offset = offsetof(VertexAux, VertexAux::color);
+			attributes[1].offset = offsetof(PackedVertexAux, PackedVertexAux::color);
 			attributes[1].format = EuropaImageFormat::RGBA8Unorm;
 
 			attributes[2].binding = 1;
 			attributes[2].location = 2;
-			attributes[2].offset = offsetof(VertexAux, VertexAux::normal);
-			attributes[2].format = EuropaImageFormat::RGB32F;
+			attributes[2].offset = offsetof(PackedVertexAux, PackedVertexAux::normal);
+			attributes[2].format = EuropaImageFormat::R32UI;
 
 			pipelineDesc.shaderStageCount = 2;
 			pipelineDesc.stages = stages;
@@ -619,7 +692,7 @@ public:
 			pipelineDesc.scissor.size = amalthea->m_windowSize;
 			pipelineDesc.depthStencil.enableDepthTest = true;
 			pipelineDesc.depthStencil.enableDepthWrite = true;
-			pipelineDesc.layout = m_pipelineLayout;
+			pipelineDesc.layout = m_tracePipelines.layout;
 			pipelineDesc.renderpass = m_mainRenderPass;
 
 			pipelineDesc.targetSubpass = forwardPass;
@@ -649,24 +722,31 @@ public:
 		// Constants & Descriptor Pools / Sets
 		EuropaDescriptorPoolSizes descPoolSizes;
 		descPoolSizes.UniformDynamic = uint32(1 * amalthea->m_frames.size());
-		descPoolSizes.UniformTexel = uint32(2 * amalthea->m_frames.size());
-		descPoolSizes.StorageImage = uint32(2 * amalthea->m_frames.size());
-		descPoolSizes.Storage = uint32(7 * amalthea->m_frames.size());
+		descPoolSizes.UniformTexel = uint32(1 * amalthea->m_frames.size());
+		descPoolSizes.StorageImage = uint32(3 * amalthea->m_frames.size());
+		descPoolSizes.Storage = uint32(24 * amalthea->m_frames.size());
 
 		m_descPool = amalthea->m_device->CreateDescriptorPool(descPoolSizes, uint32(amalthea->m_frames.size()));
 
 		for (uint32 i = 0; i < amalthea->m_frames.size(); i++)
 		{
-			m_descSets.push_back(m_descPool->AllocateDescriptorSet(descLayout));
+			m_descSets.push_back(m_descPool->AllocateDescriptorSet(m_tracePipelines.descLayout));
 		}
 
 		m_constantsSize = alignUp(uint32(sizeof(ShaderConstants)), amalthea->m_device->GetMinUniformBufferOffsetAlignment());
+
+		GanymedePrint "Created swapchain resources & pipelines in", std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - swapChainStart).count() * 1000.0, "ms";
 	};
 
 	AmaltheaBehaviors::OnDestroySwapChain f_onDestroySwapChain = [&](Amalthea* amalthea)
 	{
 		m_frameBuffers.clear();
 		m_descSets.clear();
+
+		m_profileFramebuffer = nullptr;
+		m_profileTargetView = nullptr;
+		m_profileTarget = nullptr;
+		m_profileRenderPass = nullptr;
 	};
 
 	AmaltheaBehaviors::OnRender f_onRender = [&](Amalthea* amalthea, AmaltheaFrame& ctx, float time, float deltaTime)
@@ -681,90 +761,174 @@ public:
 
 			ImGui::SetNextWindowPos(ImVec2(15, 15));
 			ImGui::Begin("", nullptr, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove);
-			ImGui::Text("Loading scene %s", m_sceneFile.c_str());
-			ImGui::BufferingBar("Progress", m_bvhBuildProgress, ImVec2(250, 6), ImU32(0xFF202020), ImU32(0xFF2080A0));
+			if (sceneLoadFailed)
+			{
+				ImGui::Text("Failed to load scene %s", m_sceneFile.c_str());
+				for (const std::string& file : m_sceneList)
+				{
+					if (file != m_sceneFile && ImGui::Selectable(file.c_str()))
+					{
+						m_sceneFile = file;
+						ReloadScene();
+						break;
+					}
+				}
+			}
+			else
+			{
+				ImGui::Text("Loading scene %s", m_sceneFile.c_str());
+				ImGui::BufferingBar("Progress", m_bvhBuildProgress, ImVec2(250, 6), ImU32(0xFF202020), ImU32(0xFF2080A0));
+			}
 			ImGui::End();
 
 			return;
 		}
 
+		if (!m_firstFrameRendered)
+		{
+			m_firstFrameRendered = true;
+
+			double firstFrame = MsSinceLoadStart();
+			GanymedePrint "Time to first frame:", firstFrame, "ms";
+
+			std::lock_guard<std::mutex> lk(m_loadTimelineLock);
+			m_loadTimeline.push_back({ "First frame", firstFrame, firstFrame });
+		}
+
 		bool clear = false;
 
+		// Toggled in the UI of the previous frame, the ray state buffers change size.
+		// The stack holds maxDepth entries per pixel and the passes run to targets.maxDepth, so the depth slider needs new targets too.
+		if (m_targets.forwardAccumulation != m_forwardAccumulation || m_targets.samplesPerFrame != m_samplesPerFrame || m_targets.maxDepth != m_maxDepth)
+		{
+			amalthea->m_cmdQueue->WaitIdle();
+			TraceTargets targets = CreateTraceTargets(amalthea->m_device, glm::uvec2(amalthea->m_windowSize), m_maxDepth, m_forwardAccumulation, glm::uvec2(0), m_samplesPerFrame);
+			if (targets.accumulation)
+			{
+				m_targets = targets;
+				clear = true;
+			}
+			else
+			{
+				// Too large for this window, keep the current targets and settings
+				m_forwardAccumulation = m_targets.forwardAccumulation;
+				m_samplesPerFrame = m_targets.samplesPerFrame;
+				m_maxDepth = m_targets.maxDepth;
+			}
+		}
+
+		// Profiled frames run the trace passes and a copy of the composite in submissions of their own, ahead of ctx.cmdlist
+		bool profiling = m_profilePasses && !m_visualize && ProfileFrame(m_profiler);
+
+		// Built once per scene, ahead of the trace passes of the first frame that uses it
+		if (m_gpuBVHBuild && !m_gpuBVH.nodes)
+		{
+			m_gpuBVH = CreateGpuBVHBuild(amalthea->m_device, m_bvhBuilder, m_sceneBuffers, m_scene->numIndices / 3);
+			RecordGpuBVHBuild(ctx.cmdlist, m_bvhBuilder, m_gpuBVH);
+			clear = true;
+			profiling = false;
+		}
+
+		TraceSceneBuffers sceneBuffers = m_sceneBuffers;
+		if (m_gpuBVHBuild)
+		{
+			sceneBuffers.nodes = m_gpuBVH.nodes;
+			sceneBuffers.nodesSize = m_gpuBVH.nodesSize;
+		}
+
+		// Orbit keys, the accumulation is reprojected to the new view or cleared
+		bool cameraMoved = false;
+
 		if (amalthea->m_ioSurface->IsKeyDown('W'))
 		{
 			m_orbitHeight += deltaTime * 0.5f;
-			clear = true;
+			cameraMoved = true;
 		}
 
 		if (amalthea->m_ioSurface->IsKeyDown('S'))
 		{
 			m_orbitHeight -= deltaTime * 0.5f;
-			clear = true;
+			cameraMoved = true;
 		}
 
 		if (amalthea->m_ioSurface->IsKeyDown('E'))
 		{
 			m_orbitRadius += deltaTime;
-			clear = true;
+			cameraMoved = true;
 		}
 		
 		if (amalthea->m_ioSurface->IsKeyDown('Q'))
 		{
 			m_orbitRadius -= deltaTime;
-			clear = true;
+			cameraMoved = true;
 		}
 
 		if (amalthea->m_ioSurface->IsKeyDown('A'))
 		{
 			m_orbitAngle += deltaTime * 3.1415926f * 0.5f;
-			clear = true;
+			cameraMoved = true;
 		}
 	
 		if (amalthea->m_ioSurface->IsKeyDown('D'))
 		{
 			m_orbitAngle -= deltaTime * 3.1415926f * 0.5f;
-			clear = true;
+			cameraMoved = true;
 		}
 
+		if (cameraMoved && !m_reprojection) clear = true;
+
 		m_frameIndex = (m_frameIndex + 1) & 0xFFFF;
 		
-		auto constantsHandle = amalthea->m_streamingBuffer->AllocateTransient(m_constantsSize);
-		ShaderConstants* constants = constantsHandle.Map<ShaderConstants>();
+		TracePassOptions options;
+		options.raySort = m_raySort;
+		options.compaction = m_compaction;
+		options.persistentGroups = m_persistentThreads ? m_persistentGroups : 0;
+		options.wavefront = m_wavefront;
+		options.constantsStride = m_constantsSize;
+		if (profiling) options.passCallback = GetPassProfilerCallback(m_profiler);
 
-		constants->viewMtx = glm::lookAt(glm::vec3(cos(m_orbitAngle) * m_orbitRadius, m_orbitHeight, sin(m_orbitAngle) * m_orbitRadius) + m_focusCenter, m_focusCenter, glm::vec3(0.0, 1.0, 0.0));
-		constants->projMtx = glm::perspective(glm::radians(60.0f), float(amalthea->m_windowSize.x) / (amalthea->m_windowSize.y), 0.01f, 256.0f);
+		std::vector<TraceTile> tiles = GetTraceTiles(m_targets);
+		uint32 numDepthCopies = GetTraceConstantCopies(m_targets, options);
 
-		constants->projMtx[1].y = -constants->projMtx[1].y;
+		auto constantsHandle = amalthea->m_streamingBuffer->AllocateTransient(m_constantsSize * numDepthCopies * uint32(tiles.size()));
 
-		constants->viewInvMtx = glm::inverse(constants->viewMtx);
-		constants->projInvMtx = glm::inverse(constants->projMtx);
+		ShaderConstants constants = {};
 
-		constants->viewportSize = glm::vec2(amalthea->m_windowSize);
+		constants.viewMtx = glm::lookAt(glm::vec3(cos(m_orbitAngle) * m_orbitRadius, m_orbitHeight, sin(m_orbitAngle) * m_orbitRadius) + m_focusCenter, m_focusCenter, glm::vec3(0.0, 1.0, 0.0));
+		constants.projMtx = glm::perspective(glm::radians(60.0f), float(amalthea->m_windowSize.x) / (amalthea->m_windowSize.y), 0.01f, 256.0f);
 
-		constants->numLights = uint32(lights.size());
-		constants->numTriangles = bvhVisStartIndex / 3;
-		constants->frameIndex = m_frameIndex;
-		constants->numRays = m_maxDepth;
-		constants->numBVHNodes = uint32(nodes.size());
-		
-		constants->ambientRadiance = m_ambientRadiance;
+		constants.projMtx[1].y = -constants.projMtx[1].y;
 
+		constants.viewInvMtx = glm::inverse(constants.viewMtx);
+		constants.projInvMtx = glm::inverse(constants.projMtx);
+
+		constants.viewportSize = glm::vec2(amalthea->m_windowSize);
+
+		constants.numLights = uint32(lights.size());
+		constants.numTriangles = m_scene->numIndices / 3;
+		constants.frameIndex = m_frameIndex;
+		constants.numRays = m_maxDepth;
+		constants.numBVHNodes = m_gpuBVHBuild ? GpuBVHNodeCount(m_gpuBVH.numTriangles) : uint32(m_scene->nodes.size());
+		
+		constants.ambientRadiance = m_ambientRadiance;
+		constants.numAreaLights = uint32(areaLights.size());
+		constants.forwardAccumulation = m_targets.forwardAccumulation ? 1 : 0;
+		constants.convergenceThreshold = m_adaptiveSampling && m_targets.convergenceMaskValid ? m_convergenceThreshold : 0.0f;
+
+		bool reproject = cameraMoved && m_reprojection && !m_visualize;
+		constants.reproject = reproject ? 1 : 0;
+		constants.prevViewMtx = m_prevViewMtx;
+		constants.prevProjMtx = m_prevProjMtx;
+		m_prevViewMtx = constants.viewMtx;
+		m_prevProjMtx = constants.projMtx;
+
+		WriteTraceConstants(constantsHandle.Map<uint8>(), m_constantsSize, constants, tiles, numDepthCopies, m_targets.samplesPerFrame);
 		constantsHandle.Unmap();
 
 		m_descSets[ctx.frameIndex]->SetUniformBufferDynamic(constantsHandle.buffer, 0, constantsHandle.offset + m_constantsSize, 0, 0);
 		if (!m_visualize)
 		{
-			m_descSets[ctx.frameIndex]->SetStorage(m_lightsBuffer, 0, uint32(lights.size() * sizeof(Light)), 1, 0);
-			m_descSets[ctx.frameIndex]->SetStorage(m_vertexBuffer, 0, uint32(bvhVisStartVertex * sizeof(VertexAux)), 2, 0);
-			m_descSets[ctx.frameIndex]->SetBufferViewUniform(m_indexBufferView, 3, 0);
-			m_descSets[ctx.frameIndex]->SetStorage(m_blueNoiseBuffer, 0, sizeof(_blueNoise), 4, 0);
-			
-			m_descSets[ctx.frameIndex]->SetImageViewStorage(m_currentImageView, EuropaImageLayout::General, 5, 0);
-			m_descSets[ctx.frameIndex]->SetImageViewStorage(m_accumulationImageViews, EuropaImageLayout::General, 6, 0);
-			m_descSets[ctx.frameIndex]->SetBufferViewUniform(m_vertexPosBufferView, 7, 0);
-			m_descSets[ctx.frameIndex]->SetStorage(m_bvhBuffer, 0, uint32(nodes.size() * sizeof(BVHNode)), 8, 0);
-			m_descSets[ctx.frameIndex]->SetStorage(m_rayStackBuffer, 0, uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * m_maxDepth * sizeof(RayStack)), 9, 0);
-			m_descSets[ctx.frameIndex]->SetStorage(m_jobBuffer, 0, uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * sizeof(RayJob)), 10, 0);
+			SetTraceDescriptors(m_descSets[ctx.frameIndex], sceneBuffers, m_targets);
 		}
 
 		EuropaClearValue clearValue[2];
@@ -773,62 +937,69 @@ public:
 
 		if (!m_visualize)
 		{
-			ctx.cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, m_pipelineLayout, m_descSets[ctx.frameIndex], 0, constantsHandle.offset);
-			ctx.cmdlist->BindCompute(m_pipelineRayLaunch);
-			ctx.cmdlist->Dispatch(uint32(ceil(float(amalthea->m_windowSize.x) / 32.0f)), uint32(ceil(float(amalthea->m_windowSize.y) / 32.0f)), 1);
-			
-			for (uint32 d = 0; d < m_maxDepth; d++)
+			EuropaCmdlist::Ref cmdlist = profiling ? BeginProfiledFrame(m_profiler) : ctx.cmdlist;
+
+			if (reproject)
 			{
-				ctx.cmdlist->Barrier(
-					m_rayStackBuffer, uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * m_maxDepth * sizeof(RayStack)), 0,
-					EuropaAccessShaderWrite, EuropaAccessShaderRead,
-					EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
-				);
-				
-				if (d == 0)
-					ctx.cmdlist->BindCompute(m_pipelineSpeculative);
-				else
-					ctx.cmdlist->BindCompute(m_pipeline);
+				RecordTraceHistory(cmdlist, m_tracePipelines, m_targets, m_descSets[ctx.frameIndex], constantsHandle.offset);
+				if (profiling) EndProfiledPass(m_profiler, cmdlist, "history", 0);
+			}
 
-				ctx.cmdlist->Dispatch(uint32(ceil(float(amalthea->m_windowSize.x) / 8.0f)), uint32(ceil(float(amalthea->m_windowSize.y) / 8.0f)), 1);
+			for (uint32 t = 0; t < tiles.size(); t++)
+			{
+				uint32 tileOffset = constantsHandle.offset + t * numDepthCopies * m_constantsSize;
+				RecordTracePasses(cmdlist, m_tracePipelines, m_targets, m_descSets[ctx.frameIndex], tiles[t], tileOffset, options);
+			}
 
-				if (m_raySort && d != m_maxDepth - 1)
-				{
-					ctx.cmdlist->Barrier(
-						m_jobBuffer, uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * sizeof(RayJob)), 0,
-						EuropaAccessShaderWrite, EuropaAccessShaderRead,
-						EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
-					);
-
-					ctx.cmdlist->BindCompute(m_pipelineRaySort);
-					ctx.cmdlist->Dispatch(uint32(ceil(float(amalthea->m_windowSize.x) / 256.0f)), uint32(amalthea->m_windowSize.y), 1);
-
-					ctx.cmdlist->Barrier(
-						m_jobBuffer, uint32(amalthea->m_windowSize.x * amalthea->m_windowSize.y * sizeof(RayJob)), 0,
-						EuropaAccessShaderWrite, EuropaAccessShaderRead,
-						EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
-					);
-				}
+			// Turning adaptive sampling back on starts with a clearing converge pass, see TraceTargets::convergenceMaskValid
+			if (m_adaptiveSampling)
+			{
+				RecordConvergence(cmdlist, m_tracePipelines, m_targets, m_descSets[ctx.frameIndex], constantsHandle.offset);
+				if (profiling) EndProfiledPass(m_profiler, cmdlist, "converge", 0);
 			}
-			
+			m_targets.convergenceMaskValid = m_adaptiveSampling;
+
+			if (profiling)
+			{
+				if (!m_profileFramebuffer) CreateProfileTarget(amalthea);
+
+				cmdlist->Barrier(
+					m_targets.accumulation,
+					EuropaAccessShaderWrite, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+					EuropaPipelineStageComputeShader, EuropaPipelineStageFragmentShader
+				);
+				cmdlist->BeginRenderpass(m_profileRenderPass, m_profileFramebuffer, glm::ivec2(0), glm::uvec2(amalthea->m_windowSize), 2, clearValue);
+				cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Graphics, m_tracePipelines.layout, m_descSets[ctx.frameIndex], 0, constantsHandle.offset);
+				cmdlist->BindPipeline(m_pipelineComposite);
+				cmdlist->DrawInstanced(6, 1, 0, 0);
+				cmdlist->EndRenderpass();
+				EndProfiledPass(m_profiler, cmdlist, "composite", 0);
+
+				EndProfiledFrame(m_profiler, cmdlist);
+				LogPassTimes(time);
+			}
+
 			ctx.cmdlist->Barrier(
-				m_accumulationImages,
-				EuropaAccessNone, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
-				EuropaPipelineStageBottomOfPipe, EuropaPipelineStageFragmentShader
+				m_targets.accumulation,
+				EuropaAccessShaderWrite, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+				EuropaPipelineStageComputeShader, EuropaPipelineStageFragmentShader
 			);
 		}
 
 		ctx.cmdlist->BeginRenderpass(m_mainRenderPass, m_frameBuffers[ctx.frameIndex], glm::ivec2(0), glm::uvec2(amalthea->m_windowSize), 2, clearValue);
-		ctx.cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Graphics, m_pipelineLayout, m_descSets[ctx.frameIndex], 0, constantsHandle.offset);
+		ctx.cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Graphics, m_tracePipelines.layout, m_descSets[ctx.frameIndex], 0, constantsHandle.offset);
 		if (m_visualize)
 		{
 			ctx.cmdlist->BindPipeline(m_pipelineVis);
-			ctx.cmdlist->BindVertexBuffer(m_vertexPosBuffer, 0, 0);
-			ctx.cmdlist->BindVertexBuffer(m_vertexBuffer, 0, 1);
-			ctx.cmdlist->BindIndexBuffer(m_indexBuffer, 0, EuropaImageFormat::R32UI);
-			ctx.cmdlist->DrawIndexed(bvhVisStartIndex, 1, 0, 0, 0);
+			ctx.cmdlist->BindVertexBuffer(m_sceneBuffers.positions, 0, 0);
+			ctx.cmdlist->BindVertexBuffer(m_sceneBuffers.aux, 0, 1);
+			ctx.cmdlist->BindIndexBuffer(m_sceneBuffers.indices, 0, EuropaImageFormat::R32UI);
+			ctx.cmdlist->DrawIndexed(m_scene->numIndices, 1, 0, 0, 0);
 			ctx.cmdlist->BindPipeline(m_pipelineVisLine);
-			ctx.cmdlist->DrawIndexed(uint32(indices.size()) - bvhVisStartIndex, 1, bvhVisStartIndex, bvhVisStartVertex, 0);
+			ctx.cmdlist->BindVertexBuffer(m_bvhVisVertexPosBuffer, 0, 0);
+			ctx.cmdlist->BindVertexBuffer(m_bvhVisVertexBuffer, 0, 1);
+			ctx.cmdlist->BindIndexBuffer(m_bvhVisIndexBuffer, 0, EuropaImageFormat::R32UI);
+			ctx.cmdlist->DrawIndexed(uint32(m_scene->visIndices.size()), 1, 0, 0, 0);
 		}
 		else
 		{
@@ -840,7 +1011,7 @@ public:
 		if (m_dumpData)
 		{
 			ctx.cmdlist->Barrier(
-				m_currentImage,
+				m_targets.current,
 				EuropaAccessNone, EuropaAccessNone, EuropaImageLayout::General, EuropaImageLayout::TransferSrc,
 				EuropaPipelineStageBottomOfPipe, EuropaPipelineStageTransfer
 			);
@@ -848,13 +1019,13 @@ public:
 			uint32 size = uint32((m_amalthea.m_windowSize.x * m_amalthea.m_windowSize.y) * sizeof(glm::u16vec4));
 			WriteBuffer(m_currentImageCpuBuffers[ctx.frameIndex], m_frameIndex, size);
 			ctx.cmdlist->CopyImageToBuffer(
-				m_currentImageCpuBuffers[ctx.frameIndex], m_currentImage, EuropaImageLayout::TransferSrc,
+				m_currentImageCpuBuffers[ctx.frameIndex], m_targets.current, EuropaImageLayout::TransferSrc,
 				0, m_amalthea.m_windowSize.x, m_amalthea.m_windowSize.y,
 				glm::uvec3(0), glm::uvec3(m_amalthea.m_windowSize.x, m_amalthea.m_windowSize.y, 1), 0
 			);
 
 			ctx.cmdlist->Barrier(
-				m_currentImage,
+				m_targets.current,
 				EuropaAccessNone, EuropaAccessNone, EuropaImageLayout::TransferSrc, EuropaImageLayout::General,
 				EuropaPipelineStageTransfer, EuropaPipelineStageTopOfPipe
 			);
@@ -873,14 +1044,40 @@ public:
 			if (ImGui::DragFloat3("Center", &m_focusCenter.x)) clear = true;
 			
 			if (ImGui::SliderInt("Max Depth", (int*)&m_maxDepth, 1, 5)) clear = true;
+			ImGui::SliderInt("Samples / Frame", (int*)&m_samplesPerFrame, 1, 16);
 
 			ImGui::Checkbox("Ray Sorting", &m_raySort);
+			ImGui::Checkbox("Compaction", &m_compaction);
+			if (m_compaction)
+			{
+				ImGui::Checkbox("Persistent Threads", &m_persistentThreads);
+				if (m_persistentThreads) ImGui::SliderInt("Persistent Groups", (int*)&m_persistentGroups, 16, 2048);
+			}
+			ImGui::Checkbox("Wavefront", &m_wavefront);
+			ImGui::Checkbox("Reprojection", &m_reprojection);
+			ImGui::Checkbox("Adaptive Sampling", &m_adaptiveSampling);
+			if (m_adaptiveSampling) ImGui::SliderFloat("Convergence Threshold", &m_convergenceThreshold, 0.001f, 0.1f, "%.3f");
+			ImGui::Checkbox("Forward Accumulation", &m_forwardAccumulation);
 			ImGui::SameLine();
 			ImGui::Checkbox("Visualization", &m_visualize);
 			ImGui::SameLine();
 			if (ImGui::Button("Reset Image")) clear = true;
 
 			ImGui::Checkbox("Dump Data", &m_dumpData);
+			ImGui::SameLine();
+			if (ImGui::Checkbox("Occluder-first BVH", &m_occluderFirstBVH)) ReloadScene();
+			ImGui::SameLine();
+			if (ImGui::Checkbox("GPU BVH", &m_gpuBVHBuild)) clear = true;
+
+			if (ImGui::TreeNode("Scene Load Timeline"))
+			{
+				std::lock_guard<std::mutex> lk(m_loadTimelineLock);
+				for (const LoadStage& stage : m_loadTimeline)
+				{
+					ImGui::Text("%-28s %8.1f -> %8.1f ms (%.1f ms)", stage.name.c_str(), stage.start, stage.end, stage.end - stage.start);
+				}
+				ImGui::TreePop();
+			}
 
 			ImPlot::SetNextPlotLimitsX(time - 5.0, time, ImGuiCond_Always);
 			ImPlot::SetNextPlotLimitsY(0.0, 40.0, ImGuiCond_Once, 0);
@@ -894,33 +1091,43 @@ public:
 				ImPlot::PlotLine("FPS", m_frameRateLog.GetDataX(), m_frameRateLog.GetDataY(), m_frameRateLog.GetSize(), m_frameRateLog.GetOffset());
 				ImPlot::EndPlot();
 			}
+
+			if (ImGui::Checkbox("Profile Passes", &m_profilePasses) && m_profilePasses && !m_profiler.log.is_open())
+			{
+				if (OpenPassProfilerLog(m_profiler, "pass_timings.csv")) GanymedePrint "Writing pass timings to pass_timings.csv";
+			}
+
+			if (m_profilePasses)
+			{
+				ImPlot::SetNextPlotLimitsX(time - 5.0, time, ImGuiCond_Always);
+				ImPlot::SetNextPlotLimitsY(0.0, 10.0, ImGuiCond_Once);
+				ImGui::Text("Wall-clock per pass of one frame in %u, %.3f ms submit overhead subtracted", ProfileInterval, std::max(m_profiler.submitOverheadMs, 0.0));
+				if (ImPlot::BeginPlot("Passes (wall-clock)", "Time", "ms", ImVec2(-1, 0))) {
+					for (auto& log : m_passTimeLogs)
+					{
+						ImPlot::PlotLine(log.first.c_str(), log.second.GetDataX(), log.second.GetDataY(), log.second.GetSize(), log.second.GetOffset());
+					}
+					ImPlot::EndPlot();
+				}
+			}
 		}
 		ImGui::End();
 
 		if (ImGui::Begin("Scene"))
 		{
-			const std::string scenes[] = { 
-				"../Models/CBbunny.ply",
-				"../Models/CBdragon.ply",
-				"../Models/CBmonkey.ply",
-				"../Models/minecraft.ply",
-				"../Models/cornellBox.ply",
-				"../Models/sponza.ply",
-				"../Models/conference.ply",
-				"../Models/livingRoom.ply",
-				"../Models/SanMiguel.ply"
-			};
-
 			static std::string current_item = m_sceneFile;
 
+			BVHChildOrder order = m_occluderFirstBVH ? BVHChildOrder::LargerFirst : BVHChildOrder::Split;
+
 			if (ImGui::BeginCombo("##combo", m_sceneFile.c_str())) // The second parameter is the label previewed before opening the combo.
 			{
-				for (int n = 0; n < IM_ARRAYSIZE(scenes); n++)
+				for (int n = 0; n < int(m_sceneList.size()); n++)
 				{
-					bool is_selected = (current_item.compare(scenes[n]) == 0); // You can store your selection however you want, outside or inside your objects
-					if (ImGui::Selectable(scenes[n].c_str(), is_selected))
+					bool is_selected = (current_item.compare(m_sceneList[n]) == 0); // You can store your selection however you want, outside or inside your objects
+					std::string label = m_sceneList[n] + (m_sceneCache.IsResident(m_sceneList[n], order) ? " (cached)" : "");
+					if (ImGui::Selectable(label.c_str(), is_selected))
 					{
-						m_sceneFile = scenes[n];
+						m_sceneFile = m_sceneList[n];
 						if (is_selected)
 							ImGui::SetItemDefaultFocus();
 						else
@@ -930,12 +1137,20 @@ public:
 				ImGui::EndCombo();
 			}
 
+			ImGui::Text("Scene cache: %zu / %zu MB", m_sceneCache.GetResidentBytes() >> 20, m_sceneCache.GetBudget() >> 20);
+
 			ImGui::Separator();
 
+			ImGui::Text("%zu lights, %zu light tree nodes", lights.size(), lightTree.size());
 			ImGui::DragFloat3("Position", &lights[0].pos.x);
 			ImGui::DragFloat3("Radiance", &lights[0].radiance.r, 0.5, 0.0);
 			ImGui::DragFloat3("Ambient Radiance", &m_ambientRadiance.x, 0.5, 0.0);
 
+			ImGui::Checkbox("Emissive triangles", &m_emissiveTriangles);
+			ImGui::SliderFloat("Emissive threshold", &m_emissiveThreshold, 0.0f, 1.0f);
+			ImGui::DragFloat("Emissive strength", &m_emissiveStrength, 0.5, 0.0);
+			ImGui::Text("%zu emissive triangles", areaLights.size());
+
 			if (ImGui::Button("Update"))
 			{
 				clear = true;
@@ -946,7 +1161,7 @@ public:
 
 		if (clear)
 		{
-			ctx.cmdlist->ClearImage(m_accumulationImages, EuropaImageLayout::General, glm::vec4(0.0));
+			ctx.cmdlist->ClearImage(m_targets.accumulation, EuropaImageLayout::General, glm::vec4(0.0));
 		}
 	};
 
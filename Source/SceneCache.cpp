@@ -0,0 +1,326 @@
+#include "SceneCache.h"
+
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+
+#include "SceneLoader.h"
+
+size_t Scene::HostBytes() const
+{
+    return nodes.size() * sizeof(BVHNode) + lights.size() * sizeof(Light) +
+        visPositions.size() * sizeof(glm::vec3) + visAux.size() * sizeof(PackedVertexAux) + visIndices.size() * sizeof(uint32) +
+        positionStorage.size() * sizeof(glm::vec3) + auxStorage.size() * sizeof(PackedVertexAux) + indexStorage.size() * sizeof(uint32);
+}
+
+template <typename Func>
+static void SceneStep(Scene& scene, const char* name, Func func)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    func();
+    scene.stages.push_back({ name, std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count() * 1000.0 });
+}
+
+// A converted scene next to a PLY (see PathTracerConvert) replaces it when it is valid and not older than the PLY
+static std::string ResolveSceneFile(const std::string& file)
+{
+    if (IsPtSceneFile(file)) return file;
+
+    std::string convertedFile = file.substr(0, file.find_last_of('.')) + ".ptscene";
+
+    std::error_code error;
+    auto convertedTime = std::filesystem::last_write_time(convertedFile, error);
+    if (error) return file;
+
+    auto plyTime = std::filesystem::last_write_time(file, error);
+    if (!error && plyTime > convertedTime)
+    {
+        GanymedePrint "Ignoring", convertedFile, "(older than", file, ")";
+        return file;
+    }
+
+    return PtScene(convertedFile).IsValid() ? convertedFile : file;
+}
+
+std::shared_ptr<Scene> LoadScene(const std::string& file, BVHChildOrder order, float& progress, const SceneGeometryCallback& onGeometry)
+{
+    std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+    scene->file = file;
+
+    std::string sceneFile = ResolveSceneFile(file);
+
+    if (IsPtSceneFile(sceneFile))
+    {
+        // Vertices and indices stay in the mapping and are uploaded from there, the BVH child order is the one it was converted with
+        SceneStep(*scene, "Map .ptscene", [&]() {
+            std::unique_ptr<PtScene> mapped = std::make_unique<PtScene>(sceneFile);
+            if (!mapped->IsValid()) return;
+
+            scene->positions = mapped->Data<glm::vec3>(PtScenePositions);
+            scene->aux = mapped->Data<PackedVertexAux>(PtSceneAux);
+            scene->indices = mapped->Data<uint32>(PtSceneIndices);
+            scene->numVertices = mapped->Count(PtScenePositions);
+            scene->numIndices = mapped->Count(PtSceneIndices);
+
+            scene->nodes.assign(mapped->Data<BVHNode>(PtSceneNodes), mapped->Data<BVHNode>(PtSceneNodes) + mapped->Count(PtSceneNodes));
+            scene->lights.assign(mapped->Data<Light>(PtSceneLights), mapped->Data<Light>(PtSceneLights) + mapped->Count(PtSceneLights));
+
+            scene->mapped = std::move(mapped);
+        });
+
+        GanymedePrint "Mapped", sceneFile, scene->mapped ? "" : "(invalid)";
+    }
+
+    // A PLY, or the PLY of a converted scene that changed since it was resolved
+    if (!scene->mapped && !IsPtSceneFile(file))
+    {
+        std::vector<glm::vec4> vertexPosition;
+        std::vector<VertexAux> vertexAuxilary;
+
+        SceneStep(*scene, "Parse PLY", [&]() {
+            LoadPly(file, vertexPosition, vertexAuxilary, scene->indexStorage);
+        });
+
+        if (scene->indexStorage.empty())
+        {
+            GanymedePrint "No triangles in", file;
+            return scene;
+        }
+
+        SceneStep(*scene, "Build BVH", [&]() {
+            scene->nodes = BuildBVH(vertexPosition, scene->indexStorage, progress, order);
+        });
+
+        SceneStep(*scene, "Reorder & pack vertices", [&]() {
+            ReorderVerticesToBVH(scene->nodes, vertexPosition, vertexAuxilary, scene->indexStorage);
+            PackVertices(vertexPosition, vertexAuxilary, scene->positionStorage, scene->auxStorage);
+        });
+
+        scene->positions = scene->positionStorage.data();
+        scene->aux = scene->auxStorage.data();
+        scene->indices = scene->indexStorage.data();
+        scene->numVertices = uint32(scene->positionStorage.size());
+        scene->numIndices = uint32(scene->indexStorage.size());
+    }
+
+    // The uploads can start while the visualization is built
+    if (onGeometry && scene->numIndices > 0 && !scene->nodes.empty()) onGeometry(scene);
+
+    SceneStep(*scene, "Visualize BVH", [&]() {
+        std::vector<glm::vec4> visPositions;
+        std::vector<VertexAux> visAux;
+        VisualizeBVH(scene->nodes, visPositions, visAux, scene->visIndices);
+        PackVertices(visPositions, visAux, scene->visPositions, scene->visAux);
+    });
+
+    return scene;
+}
+
+// Models/ may contain git-lfs pointers instead of the actual files, never prefetch those
+static bool IsLoadableScene(const std::string& file)
+{
+    if (IsPtSceneFile(file)) return std::filesystem::exists(file);
+
+    std::ifstream stream(file, std::ifstream::binary);
+    char magic[3] = {};
+    stream.read(magic, 3);
+    return stream && magic[0] == 'p' && magic[1] == 'l' && magic[2] == 'y';
+}
+
+// LoadScene for the cache: a scene that failed to load or has no triangles is reported and never cached
+static std::shared_ptr<const Scene> TryLoadScene(const std::string& file, BVHChildOrder order, float& progress, const SceneGeometryCallback& onGeometry = nullptr)
+{
+    try
+    {
+        std::shared_ptr<const Scene> scene = LoadScene(file, order, progress, onGeometry);
+        if (scene->numIndices == 0 || scene->nodes.empty())
+        {
+            GanymedePrint "Scene cache: nothing to render in", file;
+            return nullptr;
+        }
+
+        return scene;
+    }
+    catch (const std::exception& e)
+    {
+        GanymedePrint "Scene cache: failed to load", file, ":", e.what();
+        return nullptr;
+    }
+}
+
+SceneCache::SceneCache(size_t budgetBytes) : m_budget(budgetBytes)
+{
+    m_prefetchThread = std::thread([this]() { PrefetchWorker(); });
+}
+
+SceneCache::~SceneCache()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        m_terminate = true;
+    }
+    m_prefetchAvailable.notify_all();
+
+    // Waits for a prefetch that is already running
+    m_prefetchThread.join();
+}
+
+std::string SceneCache::Key(const std::string& file, BVHChildOrder order)
+{
+    // A mapped scene keeps the child order it was converted with, whatever order is asked for
+    std::string sceneFile = ResolveSceneFile(file);
+    if (IsPtSceneFile(sceneFile)) return sceneFile + "|converted";
+
+    return file + (order == BVHChildOrder::LargerFirst ? "|larger" : "|split");
+}
+
+std::shared_ptr<const Scene> SceneCache::Get(const std::string& file, BVHChildOrder order, float& progress, bool* cacheHit, const SceneGeometryCallback& onGeometry)
+{
+    std::string key = Key(file, order);
+
+    std::unique_lock<std::mutex> lk(m_lock);
+    m_loaded.wait(lk, [&]() { return m_entries.count(key) == 0 || !m_entries[key].loading; });
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        Touch(it->second, key);
+        if (cacheHit) *cacheHit = true;
+        progress = 1.0f;
+
+        std::shared_ptr<const Scene> scene = it->second.scene;
+        lk.unlock();
+
+        if (onGeometry) onGeometry(scene);
+        return scene;
+    }
+
+    if (cacheHit) *cacheHit = false;
+
+    m_entries[key].loading = true;
+    lk.unlock();
+
+    std::shared_ptr<const Scene> scene = TryLoadScene(file, order, progress, onGeometry);
+
+    // On failure the entry goes away, so a waiting Get of the same scene tries again instead of waiting forever
+    lk.lock();
+    if (scene)
+    {
+        Insert(key, scene);
+        Evict(key);
+    }
+    else
+    {
+        m_entries.erase(key);
+    }
+    lk.unlock();
+
+    m_loaded.notify_all();
+
+    return scene;
+}
+
+void SceneCache::Prefetch(const std::string& file, BVHChildOrder order)
+{
+    std::string key = Key(file, order);
+    {
+        std::lock_guard<std::mutex> lk(m_lock);
+        if (m_entries.count(key)) return;
+        m_prefetchQueue.push_back({ file, order });
+    }
+    m_prefetchAvailable.notify_one();
+}
+
+bool SceneCache::IsResident(const std::string& file, BVHChildOrder order)
+{
+    std::string key = Key(file, order);
+
+    std::lock_guard<std::mutex> lk(m_lock);
+    auto it = m_entries.find(key);
+    return it != m_entries.end() && !it->second.loading;
+}
+
+size_t SceneCache::GetResidentBytes()
+{
+    std::lock_guard<std::mutex> lk(m_lock);
+    return m_residentBytes;
+}
+
+void SceneCache::Insert(const std::string& key, std::shared_ptr<const Scene> scene)
+{
+    Entry& entry = m_entries[key];
+    entry.scene = scene;
+    entry.loading = false;
+
+    m_lru.push_front(key);
+    entry.lru = m_lru.begin();
+
+    m_residentBytes += scene->HostBytes();
+}
+
+void SceneCache::Touch(Entry& entry, const std::string& key)
+{
+    m_lru.erase(entry.lru);
+    m_lru.push_front(key);
+    entry.lru = m_lru.begin();
+}
+
+void SceneCache::Evict(const std::string& keep)
+{
+    while (m_residentBytes > m_budget && !m_lru.empty() && m_lru.back() != keep)
+    {
+        std::string key = m_lru.back();
+        m_lru.pop_back();
+
+        m_residentBytes -= m_entries[key].scene->HostBytes();
+        m_entries.erase(key);
+
+        GanymedePrint "Scene cache: evicted", key;
+    }
+}
+
+void SceneCache::PrefetchWorker()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lk(m_lock);
+        m_prefetchAvailable.wait(lk, [&]() { return m_terminate || !m_prefetchQueue.empty(); });
+
+        if (m_terminate) return;
+
+        auto [file, order] = m_prefetchQueue.front();
+        m_prefetchQueue.pop_front();
+
+        lk.unlock();
+        std::string key = Key(file, order);
+        lk.lock();
+
+        if (m_entries.count(key)) continue;
+
+        m_entries[key].loading = true;
+        lk.unlock();
+
+        std::shared_ptr<const Scene> scene;
+        if (IsLoadableScene(file))
+        {
+            float progress = 0.0f;
+            scene = TryLoadScene(file, order, progress);
+        }
+
+        lk.lock();
+        if (scene)
+        {
+            Insert(key, scene);
+            Evict(key);
+            GanymedePrint "Scene cache: prefetched", file, "(", m_residentBytes / (1024 * 1024), "/", m_budget / (1024 * 1024), "MB resident )";
+        }
+        else
+        {
+            m_entries.erase(key);
+        }
+        lk.unlock();
+
+        m_loaded.notify_all();
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderData.h"
+#include "BVH.h"
+#include "SceneFormat.h"
+
+// CPU side of a loaded scene, everything the GPU buffers are created from.
+// The vertex / index arrays point either into the storage vectors or into a mapped .ptscene.
+struct Scene
+{
+    std::string file;
+
+    const glm::vec3* positions = nullptr;
+    const PackedVertexAux* aux = nullptr;
+    const uint32* indices = nullptr;
+    uint32 numVertices = 0;
+    uint32 numIndices = 0;
+
+    std::vector<BVHNode> nodes;
+    std::vector<Light> lights; // Only set when the file stores lights
+
+    // BVH visualization geometry
+    std::vector<glm::vec3> visPositions;
+    std::vector<PackedVertexAux> visAux;
+    std::vector<uint32> visIndices;
+
+    // How long each load step took (ms), in order
+    std::vector<std::pair<std::string, double>> stages;
+
+    std::vector<glm::vec3> positionStorage;
+    std::vector<PackedVertexAux> auxStorage;
+    std::vector<uint32> indexStorage;
+    std::unique_ptr<PtScene> mapped;
+
+    // Host memory held by the scene, mapped files are not counted
+    size_t HostBytes() const;
+};
+
+// Called once the vertices, indices, BVH and lights of a scene are final, the BVH visualization may still be in the making.
+// The scene may still fail to load after that, holding on to it keeps it alive.
+typedef std::function<void(std::shared_ptr<const Scene>)> SceneGeometryCallback;
+
+// Loads a .ptscene, or a PLY: parse, build, reorder, pack and visualize. A valid .ptscene next to the PLY that is not older
+// than it is mapped instead.
+std::shared_ptr<Scene> LoadScene(const std::string& file, BVHChildOrder order, float& progress, const SceneGeometryCallback& onGeometry = nullptr);
+
+// LRU cache of loaded scenes within a host memory budget. Prefetch() loads scenes on a background thread,
+// Get() waits for a running prefetch of the same scene instead of loading it twice.
+// Evicted scenes stay alive as long as someone still holds them. Scenes that fail to load or have no triangles are not
+// cached, Get() returns nullptr for them.
+class SceneCache
+{
+public:
+    SceneCache(size_t budgetBytes);
+    ~SceneCache();
+
+    // onGeometry is called from the loading thread ahead of the return, or right away for a cached scene
+    std::shared_ptr<const Scene> Get(const std::string& file, BVHChildOrder order, float& progress, bool* cacheHit = nullptr, const SceneGeometryCallback& onGeometry = nullptr);
+    void Prefetch(const std::string& file, BVHChildOrder order);
+
+    bool IsResident(const std::string& file, BVHChildOrder order);
+    size_t GetResidentBytes();
+    size_t GetBudget() const { return m_budget; }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const Scene> scene;
+        bool loading = false;
+        std::list<std::string>::iterator lru;
+    };
+
+    static std::string Key(const std::string& file, BVHChildOrder order);
+
+    void Insert(const std::string& key, std::shared_ptr<const Scene> scene);
+    void Touch(Entry& entry, const std::string& key);
+    void Evict(const std::string& keep);
+    void PrefetchWorker();
+
+    size_t m_budget;
+    size_t m_residentBytes = 0;
+
+    std::mutex m_lock;
+    std::condition_variable m_loaded;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // Most recently used first
+
+    std::condition_variable m_prefetchAvailable;
+    std::deque<std::pair<std::string, BVHChildOrder>> m_prefetchQueue;
+    bool m_terminate = false;
+    std::thread m_prefetchThread;
+};
@@ -0,0 +1,88 @@
+#include <Ganymede/Source/Ganymede.h>
+
+#include <chrono>
+
+#include "ShaderData.h"
+#include "BVH.h"
+#include "SceneLoader.h"
+#include "SceneFormat.h"
+
+// PLY -> .ptscene converter:
+//   PathTracerConvert input.ply [output.ptscene] [--split-order] [--light x y z r g b]...
+// Builds the BVH offline so the app only has to map and upload the result.
+
+int main(int argc, char** argv)
+{
+    std::string input;
+    std::string output;
+    BVHChildOrder order = BVHChildOrder::LargerFirst;
+    std::vector<Light> lights;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--split-order") order = BVHChildOrder::Split;
+        else if (arg == "--light" && i + 6 < argc)
+        {
+            Light light;
+            light.pos = glm::vec3(std::stof(argv[i + 1]), std::stof(argv[i + 2]), std::stof(argv[i + 3]));
+            light.radiance = glm::vec3(std::stof(argv[i + 4]), std::stof(argv[i + 5]), std::stof(argv[i + 6]));
+            lights.push_back(light);
+            i += 6;
+        }
+        else if (input.empty()) input = arg;
+        else output = arg;
+    }
+
+    if (input.empty())
+    {
+        GanymedePrint "Usage: PathTracerConvert input.ply [output.ptscene] [--split-order] [--light x y z r g b]...";
+        return 1;
+    }
+
+    if (output.empty())
+    {
+        output = input.substr(0, input.find_last_of('.')) + ".ptscene";
+    }
+
+    // Same default light as the app
+    if (lights.empty())
+    {
+        lights.push_back({ glm::vec3(0.0, 1.4, 0.0), glm::vec3(1.0, 1.0, 1.0) });
+    }
+
+    std::vector<glm::vec4> vertexPosition;
+    std::vector<VertexAux> vertexAuxilary;
+    std::vector<uint32> indices;
+
+    LoadPly(input, vertexPosition, vertexAuxilary, indices);
+
+    if (indices.empty())
+    {
+        GanymedePrint "No triangles in", input;
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    float progress = 0.0f;
+    std::vector<BVHNode> nodes = BuildBVH(vertexPosition, indices, progress, order);
+
+    GanymedePrint "Built BVH in", std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count() * 1000.0, "ms,", nodes.size(), "nodes";
+
+    ReorderVerticesToBVH(nodes, vertexPosition, vertexAuxilary, indices);
+
+    std::vector<glm::vec3> packedPosition;
+    std::vector<PackedVertexAux> packedAuxilary;
+    PackVertices(vertexPosition, vertexAuxilary, packedPosition, packedAuxilary);
+
+    if (!WritePtScene(output, packedPosition, packedAuxilary, indices, nodes, lights))
+    {
+        GanymedePrint "Failed to write", output;
+        return 1;
+    }
+
+    GanymedePrint "Wrote", output, "(", vertexPosition.size(), "vertices,", indices.size() / 3, "triangles )";
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include "SceneFormat.h"
+
+#include <cstring>
+#include <fstream>
+
+static const uint32 sectionStrides[PtSceneSectionCount] = {
+    sizeof(glm::vec3),
+    sizeof(PackedVertexAux),
+    sizeof(uint32),
+    sizeof(BVHNode),
+    sizeof(Light),
+};
+
+static uint64 AlignSection(uint64 offset)
+{
+    return (offset + PTSCENE_ALIGNMENT - 1) / PTSCENE_ALIGNMENT * PTSCENE_ALIGNMENT;
+}
+
+bool WritePtScene(const std::string& path, const std::vector<glm::vec3>& vertexPosition, const std::vector<PackedVertexAux>& vertexAuxilary,
+    const std::vector<uint32>& indices, const std::vector<BVHNode>& nodes, const std::vector<Light>& lights)
+{
+    const void* data[PtSceneSectionCount] = { vertexPosition.data(), vertexAuxilary.data(), indices.data(), nodes.data(), lights.data() };
+    const size_t counts[PtSceneSectionCount] = { vertexPosition.size(), vertexAuxilary.size(), indices.size(), nodes.size(), lights.size() };
+
+    PtSceneHeader header = {};
+    memcpy(header.magic, PTSCENE_MAGIC, sizeof(PTSCENE_MAGIC));
+    header.version = PTSCENE_VERSION;
+    header.sectionCount = PtSceneSectionCount;
+
+    uint64 offset = AlignSection(sizeof(PtSceneHeader));
+    for (uint32 i = 0; i < PtSceneSectionCount; i++)
+    {
+        header.sections[i].offset = offset;
+        header.sections[i].count = uint32(counts[i]);
+        header.sections[i].stride = sectionStrides[i];
+        header.sections[i].size = uint64(counts[i]) * sectionStrides[i];
+        offset = AlignSection(offset + header.sections[i].size);
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    const char padding[PTSCENE_ALIGNMENT] = {};
+
+    file.write((const char*)&header, sizeof(header));
+    uint64 written = sizeof(header);
+
+    for (uint32 i = 0; i < PtSceneSectionCount; i++)
+    {
+        file.write(padding, std::streamsize(header.sections[i].offset - written));
+        file.write((const char*)data[i], std::streamsize(header.sections[i].size));
+        written = header.sections[i].offset + header.sections[i].size;
+    }
+
+    file.write(padding, std::streamsize(offset - written));
+
+    return bool(file);
+}
+
+PtScene::PtScene(const std::string& path) : m_file(path)
+{
+    if (!m_file.IsOpen() || m_file.Size() < sizeof(PtSceneHeader)) return;
+
+    const PtSceneHeader* header = (const PtSceneHeader*)m_file.Data();
+
+    if (memcmp(header->magic, PTSCENE_MAGIC, sizeof(PTSCENE_MAGIC)) != 0 || header->version != PTSCENE_VERSION || header->sectionCount != PtSceneSectionCount)
+    {
+        GanymedePrint path, "is not a version", PTSCENE_VERSION, ".ptscene file";
+        return;
+    }
+
+    for (uint32 i = 0; i < PtSceneSectionCount; i++)
+    {
+        const PtSceneSectionInfo& section = header->sections[i];
+        if (section.stride != sectionStrides[i] || section.size != uint64(section.count) * section.stride ||
+            section.offset % PTSCENE_ALIGNMENT != 0 || section.offset + section.size > m_file.Size())
+        {
+            GanymedePrint path, "has a corrupt section", i;
+            return;
+        }
+    }
+
+    // Contents, so a stale or edited file can't make the tracer read out of bounds. Cheap next to the load it replaces.
+    const PtSceneSectionInfo* sections = header->sections;
+    uint32 numVertices = sections[PtScenePositions].count;
+    uint32 numIndices = sections[PtSceneIndices].count;
+    uint32 numNodes = sections[PtSceneNodes].count;
+
+    if (sections[PtSceneAux].count != numVertices || numIndices % 3 != 0)
+    {
+        GanymedePrint path, "has", numVertices, "positions,", sections[PtSceneAux].count, "aux and", numIndices, "indices";
+        return;
+    }
+
+    const uint32* indices = (const uint32*)(m_file.Data() + sections[PtSceneIndices].offset);
+    for (uint32 i = 0; i < numIndices; i++)
+    {
+        if (indices[i] >= numVertices)
+        {
+            GanymedePrint path, "has index", indices[i], "at", i, "past its", numVertices, "vertices";
+            return;
+        }
+    }
+
+    const BVHNode* nodes = (const BVHNode*)(m_file.Data() + sections[PtSceneNodes].offset);
+    for (uint32 i = 0; i < numNodes; i++)
+    {
+        // Leaves point at their first index with right = -offset, inner nodes at their right child
+        int32 right = nodes[i].right;
+        bool valid = right <= 0 ? uint64(-int64(right)) + 3 <= numIndices : uint32(right) < numNodes;
+        if (!valid)
+        {
+            GanymedePrint path, "has node", i, "pointing past the scene with", right;
+            return;
+        }
+    }
+
+    m_header = header;
+}
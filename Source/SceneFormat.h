@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <string>
+#include <vector>
+
+#include "ShaderData.h"
+#include "BVH.h"
+#include "MappedFile.h"
+
+// .ptscene: native scene container. Every section holds the exact bytes of the GPU buffer it is uploaded into
+// (packed vertices, indices already in BVH order), starting on a 64 byte boundary, so a mapped file can be uploaded as is.
+//   [PtSceneHeader][positions][aux][indices][nodes][lights]
+
+#define PTSCENE_MAGIC "PTSCENE"
+#define PTSCENE_VERSION 2
+#define PTSCENE_ALIGNMENT 64
+
+enum PtSceneSection : uint32
+{
+    PtScenePositions,   // glm::vec3
+    PtSceneAux,         // PackedVertexAux
+    PtSceneIndices,     // uint32, 3 per triangle
+    PtSceneNodes,       // BVHNode
+    PtSceneLights,      // Light
+    PtSceneSectionCount
+};
+
+struct PtSceneSectionInfo
+{
+    uint64 offset;
+    uint64 size;
+    uint32 count;
+    uint32 stride;
+};
+
+struct PtSceneHeader
+{
+    char magic[8];
+    uint32 version;
+    uint32 sectionCount;
+    PtSceneSectionInfo sections[PtSceneSectionCount];
+};
+
+bool WritePtScene(const std::string& path, const std::vector<glm::vec3>& vertexPosition, const std::vector<PackedVertexAux>& vertexAuxilary,
+    const std::vector<uint32>& indices, const std::vector<BVHNode>& nodes, const std::vector<Light>& lights);
+
+// Mapped .ptscene, section pointers stay valid as long as the object is alive
+class PtScene
+{
+public:
+    PtScene(const std::string& path);
+
+    bool IsValid() const { return m_header != nullptr; }
+
+    uint32 Count(PtSceneSection section) const { return m_header->sections[section].count; }
+    uint64 Size(PtSceneSection section) const { return m_header->sections[section].size; }
+
+    template <typename T>
+    const T* Data(PtSceneSection section) const { return (const T*)(m_file.Data() + m_header->sections[section].offset); }
+
+private:
+    MappedFile m_file;
+    const PtSceneHeader* m_header = nullptr;
+};
+
+inline bool IsPtSceneFile(const std::string& path)
+{
+    const std::string ext = ".ptscene";
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
@@ -0,0 +1,603 @@
+#include "SceneLoader.h"
+
+#include "Himalia/Source/Himalia.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include "MappedFile.h"
+
+enum class PlyType
+{
+    Invalid,
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type = PlyType::Invalid;
+    PlyType countType = PlyType::Invalid; // Valid for list properties only
+    uint32 offset = 0;
+};
+
+struct PlyElement
+{
+    std::string name;
+    uint64 count = 0;
+    std::vector<PlyProperty> properties;
+    uint32 stride = 0; // Only meaningful without list properties
+    bool hasList = false;
+
+    const PlyProperty* Find(const char* propertyName) const
+    {
+        for (const PlyProperty& p : properties)
+        {
+            if (p.name == propertyName) return &p;
+        }
+        return nullptr;
+    }
+};
+
+inline PlyType ParsePlyType(const std::string& name)
+{
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::UInt32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    return PlyType::Invalid;
+}
+
+inline uint32 PlyTypeSize(PlyType type)
+{
+    switch (type)
+    {
+    case PlyType::Int8: case PlyType::UInt8: return 1;
+    case PlyType::Int16: case PlyType::UInt16: return 2;
+    case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+    case PlyType::Float64: return 8;
+    default: return 0;
+    }
+}
+
+// PLY data is little endian, as is every platform we run on
+template <typename T>
+inline T ReadUnaligned(const uint8* p)
+{
+    T v;
+    memcpy(&v, p, sizeof(T));
+    return v;
+}
+
+inline double ReadPly(const uint8* p, PlyType type)
+{
+    switch (type)
+    {
+    case PlyType::Int8: return ReadUnaligned<int8>(p);
+    case PlyType::UInt8: return ReadUnaligned<uint8>(p);
+    case PlyType::Int16: return ReadUnaligned<int16>(p);
+    case PlyType::UInt16: return ReadUnaligned<uint16>(p);
+    case PlyType::Int32: return ReadUnaligned<int32>(p);
+    case PlyType::UInt32: return ReadUnaligned<uint32>(p);
+    case PlyType::Float32: return ReadUnaligned<float>(p);
+    case PlyType::Float64: return ReadUnaligned<double>(p);
+    default: return 0.0;
+    }
+}
+
+// Splits [0, count) into one contiguous range per hardware thread
+template <typename Func>
+void ParallelFor(uint64 count, Func func)
+{
+    uint64 numThreads = std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::max<uint64>(1, std::min(numThreads, count / 4096));
+
+    uint64 chunk = (count + numThreads - 1) / numThreads;
+
+    std::vector<std::thread> threads;
+    for (uint64 t = 1; t < numThreads; t++)
+    {
+        uint64 begin = t * chunk;
+        uint64 end = std::min(count, begin + chunk);
+        if (begin < end) threads.push_back(std::thread(func, begin, end));
+    }
+
+    func(uint64(0), std::min(count, chunk));
+
+    for (auto& t : threads) t.join();
+}
+
+static void AtomicMax(std::atomic<uint32>& value, uint32 x)
+{
+    uint32 current = value;
+    while (x > current && !value.compare_exchange_weak(current, x));
+}
+
+// Largest index, reduced per ParallelFor chunk. 0 for no indices.
+static uint32 MaxIndex(const std::vector<uint32>& indices)
+{
+    std::atomic<uint32> maxIndex = 0;
+    ParallelFor(indices.size(), [&](uint64 begin, uint64 end)
+    {
+        uint32 chunkMax = 0;
+        for (uint64 i = begin; i < end; i++) chunkMax = std::max(chunkMax, indices[i]);
+        AtomicMax(maxIndex, chunkMax);
+    });
+    return maxIndex;
+}
+
+bool ParsePlyHeader(const MappedFile& file, std::vector<PlyElement>& elements, size_t& dataOffset)
+{
+    const char* text = (const char*)file.Data();
+    const char* endHeader = nullptr;
+
+    for (size_t i = 0; i + 10 <= file.Size() && i < 65536; i++)
+    {
+        if (memcmp(text + i, "end_header", 10) == 0)
+        {
+            endHeader = text + i;
+            break;
+        }
+    }
+
+    if (endHeader == nullptr) return false;
+
+    const char* dataStart = (const char*)memchr(endHeader, '\n', file.Size() - (endHeader - text));
+    if (dataStart == nullptr) return false;
+    dataOffset = size_t(dataStart + 1 - text);
+
+    std::istringstream header(std::string(text, endHeader));
+    std::string line;
+
+    if (!std::getline(header, line) || line.compare(0, 3, "ply") != 0) return false;
+
+    while (std::getline(header, line))
+    {
+        std::istringstream ss(line);
+        std::string keyword;
+        ss >> keyword;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            ss >> format;
+            if (format != "binary_little_endian") return false;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            ss >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property")
+        {
+            if (elements.empty()) return false;
+
+            PlyElement& element = elements.back();
+            PlyProperty property;
+            std::string type;
+            ss >> type;
+
+            if (type == "list")
+            {
+                std::string countType, itemType;
+                ss >> countType >> itemType >> property.name;
+                property.countType = ParsePlyType(countType);
+                property.type = ParsePlyType(itemType);
+                if (property.countType == PlyType::Invalid) return false;
+                element.hasList = true;
+            }
+            else
+            {
+                ss >> property.name;
+                property.type = ParsePlyType(type);
+            }
+
+            if (property.type == PlyType::Invalid) return false;
+
+            property.offset = element.stride;
+            element.stride += PlyTypeSize(property.type);
+            element.properties.push_back(property);
+        }
+    }
+
+    return true;
+}
+
+inline uint8 ReadColor(const uint8* p, const PlyProperty* property)
+{
+    if (property == nullptr) return 255;
+
+    double v = ReadPly(p + property->offset, property->type);
+    if (property->type == PlyType::Float32 || property->type == PlyType::Float64) v *= 255.0;
+
+    return uint8(std::min(255.0, std::max(0.0, v)));
+}
+
+// binary_little_endian PLYs are mapped and parsed in place, every thread writes its slice of the final arrays.
+// Returns false for anything else so the caller can fall back to Himalia, and for face indices past the vertex count.
+bool LoadBinaryPly(const std::string& fileName, std::vector<glm::vec4>& vertexPosition, std::vector<VertexAux>& vertexAuxilary, std::vector<uint32>& indices)
+{
+    MappedFile file(fileName);
+    if (!file.IsOpen()) return false;
+
+    std::vector<PlyElement> elements;
+    size_t offset;
+    if (!ParsePlyHeader(file, elements, offset)) return false;
+
+    const PlyElement* vertexElement = nullptr;
+    const PlyElement* faceElement = nullptr;
+    size_t vertexOffset = 0, faceOffset = 0;
+
+    // Locate the vertex & face sections, elements in front of them must have a fixed size
+    for (const PlyElement& element : elements)
+    {
+        if (element.name == "vertex")
+        {
+            if (element.hasList) return false;
+            vertexElement = &element;
+            vertexOffset = offset;
+        }
+        else if (element.name == "face")
+        {
+            faceElement = &element;
+            faceOffset = offset;
+        }
+
+        if (vertexElement && faceElement) break;
+        if (element.hasList) return false;
+
+        offset += size_t(element.count * element.stride);
+    }
+
+    if (!vertexElement || !faceElement) return false;
+    if (vertexOffset + vertexElement->count * vertexElement->stride > file.Size()) return false;
+
+    const PlyProperty* px = vertexElement->Find("x");
+    const PlyProperty* py = vertexElement->Find("y");
+    const PlyProperty* pz = vertexElement->Find("z");
+    const PlyProperty* pnx = vertexElement->Find("nx");
+    const PlyProperty* pny = vertexElement->Find("ny");
+    const PlyProperty* pnz = vertexElement->Find("nz");
+    const PlyProperty* pr = vertexElement->Find("red");
+    const PlyProperty* pg = vertexElement->Find("green");
+    const PlyProperty* pb = vertexElement->Find("blue");
+    const PlyProperty* pa = vertexElement->Find("alpha");
+
+    if (!px || !py || !pz) return false;
+
+    const PlyProperty* pIndices = faceElement->Find("vertex_indices");
+    if (!pIndices) pIndices = faceElement->Find("vertex_index");
+    if (!pIndices || pIndices->countType == PlyType::Invalid) return false;
+
+    // Vertices
+    vertexPosition.resize(size_t(vertexElement->count));
+    vertexAuxilary.resize(size_t(vertexElement->count));
+
+    const uint8* vertexData = file.Data() + vertexOffset;
+    const uint32 vertexStride = vertexElement->stride;
+
+    ParallelFor(vertexElement->count, [&](uint64 begin, uint64 end)
+    {
+        for (uint64 i = begin; i < end; i++)
+        {
+            const uint8* v = vertexData + i * vertexStride;
+
+            vertexPosition[i] = glm::vec4(
+                float(ReadPly(v + px->offset, px->type)),
+                float(ReadPly(v + py->offset, py->type)),
+                float(ReadPly(v + pz->offset, pz->type)),
+                1.0f
+            );
+
+            VertexAux& aux = vertexAuxilary[i];
+            aux.normal = glm::vec3(
+                pnx ? float(ReadPly(v + pnx->offset, pnx->type)) : 0.0f,
+                pny ? float(ReadPly(v + pny->offset, pny->type)) : 0.0f,
+                pnz ? float(ReadPly(v + pnz->offset, pnz->type)) : 0.0f
+            );
+            aux.color = glm::u8vec4(ReadColor(v, pr), ReadColor(v, pg), ReadColor(v, pb), ReadColor(v, pa));
+        }
+    });
+
+    // Faces. With only the index list and triangles everywhere each face has the same size and
+    // can be read in parallel; the counts are verified while reading.
+    const uint8* faceData = file.Data() + faceOffset;
+    const uint32 countSize = PlyTypeSize(pIndices->countType);
+    const uint32 indexSize = PlyTypeSize(pIndices->type);
+    const uint64 triangleStride = countSize + 3 * indexSize;
+    const uint64 numFaces = faceElement->count;
+
+    bool fixedStride = faceElement->properties.size() == 1 && faceOffset + numFaces * triangleStride <= file.Size();
+
+    if (fixedStride)
+    {
+        std::atomic<bool> allTriangles = true;
+        std::atomic<uint32> maxIndex = 0;
+        indices.resize(size_t(numFaces * 3));
+
+        ParallelFor(numFaces, [&](uint64 begin, uint64 end)
+        {
+            uint32 chunkMax = 0;
+            for (uint64 i = begin; i < end; i++)
+            {
+                const uint8* f = faceData + i * triangleStride;
+
+                if (ReadPly(f, pIndices->countType) != 3.0)
+                {
+                    allTriangles = false;
+                    return;
+                }
+
+                indices[i * 3] = uint32(ReadPly(f + countSize, pIndices->type));
+                indices[i * 3 + 1] = uint32(ReadPly(f + countSize + indexSize, pIndices->type));
+                indices[i * 3 + 2] = uint32(ReadPly(f + countSize + 2 * indexSize, pIndices->type));
+
+                chunkMax = std::max(chunkMax, std::max(indices[i * 3], std::max(indices[i * 3 + 1], indices[i * 3 + 2])));
+            }
+
+            AtomicMax(maxIndex, chunkMax);
+        });
+
+        fixedStride = allTriangles;
+        if (fixedStride && numFaces > 0 && maxIndex >= vertexElement->count) return false;
+    }
+
+    if (!fixedStride)
+    {
+        // Polygons (or extra face properties): walk the section sequentially and fan-triangulate
+        indices.clear();
+        indices.reserve(size_t(numFaces * 3));
+
+        const uint8* f = faceData;
+        const uint8* fileEnd = file.Data() + file.Size();
+        std::vector<uint32> polygon;
+
+        for (uint64 i = 0; i < numFaces; i++)
+        {
+            for (const PlyProperty& property : faceElement->properties)
+            {
+                if (property.countType == PlyType::Invalid)
+                {
+                    f += PlyTypeSize(property.type);
+                    continue;
+                }
+
+                if (f + PlyTypeSize(property.countType) > fileEnd) return false;
+                uint32 count = uint32(ReadPly(f, property.countType));
+                f += PlyTypeSize(property.countType);
+
+                if (f + size_t(count) * PlyTypeSize(property.type) > fileEnd) return false;
+
+                if (&property == pIndices)
+                {
+                    polygon.resize(count);
+                    for (uint32 k = 0; k < count; k++)
+                    {
+                        polygon[k] = uint32(ReadPly(f + k * PlyTypeSize(property.type), property.type));
+                        if (polygon[k] >= vertexElement->count) return false;
+                    }
+
+                    for (uint32 k = 1; k + 1 < count; k++)
+                    {
+                        indices.push_back(polygon[0]);
+                        indices.push_back(polygon[k]);
+                        indices.push_back(polygon[k + 1]);
+                    }
+                }
+
+                f += size_t(count) * PlyTypeSize(property.type);
+            }
+        }
+    }
+
+    return true;
+}
+
+struct WeldKey
+{
+    int64 position[3];
+    int32 normal[3];
+    glm::u8vec4 color;
+
+    bool operator==(const WeldKey& other) const
+    {
+        return memcmp(position, other.position, sizeof(position)) == 0 && memcmp(normal, other.normal, sizeof(normal)) == 0 && color == other.color;
+    }
+};
+
+struct WeldKeyHash
+{
+    size_t operator()(const WeldKey& key) const { return size_t(Hash(key)); }
+
+    static uint64 Hash(const WeldKey& key)
+    {
+        uint64 h = 14695981039346656037ull;
+        auto mix = [&](uint64 v) { h = (h ^ v) * 1099511628211ull; h ^= h >> 29; };
+        for (int i = 0; i < 3; i++) mix(uint64(key.position[i]));
+        for (int i = 0; i < 3; i++) mix(uint64(uint32(key.normal[i])));
+        mix(uint64(key.color.r) | uint64(key.color.g) << 8 | uint64(key.color.b) << 16 | uint64(key.color.a) << 24);
+        return h;
+    }
+};
+
+void WeldVertices(std::vector<glm::vec4>& vertexPosition, std::vector<VertexAux>& vertexAuxilary, std::vector<uint32>& indices, float positionTolerance, float normalTolerance)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const uint32 numVertices = uint32(vertexPosition.size());
+    if (numVertices == 0 || vertexAuxilary.size() != numVertices) return;
+
+    // Quantize & hash
+    std::vector<WeldKey> keys(numVertices);
+    std::vector<uint64> hashes(numVertices);
+
+    ParallelFor(numVertices, [&](uint64 begin, uint64 end)
+    {
+        for (uint64 i = begin; i < end; i++)
+        {
+            WeldKey& key = keys[i];
+            for (int c = 0; c < 3; c++)
+            {
+                key.position[c] = int64(std::llround(double(vertexPosition[i][c]) / positionTolerance));
+                key.normal[c] = int32(std::lround(vertexAuxilary[i].normal[c] / normalTolerance));
+            }
+            key.color = vertexAuxilary[i].color;
+            hashes[i] = WeldKeyHash::Hash(key);
+        }
+    });
+
+    // Bucket the vertices into shards by the top hash bits, in their original order
+    const uint32 shardBits = 6;
+    const uint32 numShards = 1 << shardBits;
+
+    std::vector<uint32> shardStart(numShards + 1, 0);
+    for (uint32 i = 0; i < numVertices; i++) shardStart[(hashes[i] >> (64 - shardBits)) + 1]++;
+    for (uint32 s = 0; s < numShards; s++) shardStart[s + 1] += shardStart[s];
+
+    std::vector<uint32> shardVertices(numVertices);
+    {
+        std::vector<uint32> cursor(shardStart.begin(), shardStart.end() - 1);
+        for (uint32 i = 0; i < numVertices; i++) shardVertices[cursor[hashes[i] >> (64 - shardBits)]++] = i;
+    }
+
+    // Each shard maps its vertices to the first equal one, shards never share a key
+    std::vector<uint32> remap(numVertices);
+    std::atomic<uint32> nextShard = 0;
+
+    auto weldShards = [&]()
+    {
+        std::unordered_map<WeldKey, uint32, WeldKeyHash> unique;
+        for (uint32 s = nextShard++; s < numShards; s = nextShard++)
+        {
+            unique.clear();
+            unique.reserve(shardStart[s + 1] - shardStart[s]);
+
+            for (uint32 j = shardStart[s]; j < shardStart[s + 1]; j++)
+            {
+                uint32 i = shardVertices[j];
+                remap[i] = unique.emplace(keys[i], i).first->second;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32 t = 1; t < std::min(numShards, std::max(1u, std::thread::hardware_concurrency())); t++)
+    {
+        threads.push_back(std::thread(weldShards));
+    }
+    weldShards();
+    for (auto& t : threads) t.join();
+
+    // Compact, representatives keep their relative order
+    std::vector<uint32> newIndex(numVertices);
+    uint32 numUnique = 0;
+    for (uint32 i = 0; i < numVertices; i++)
+    {
+        if (remap[i] == i)
+        {
+            vertexPosition[numUnique] = vertexPosition[i];
+            vertexAuxilary[numUnique] = vertexAuxilary[i];
+            newIndex[i] = numUnique++;
+        }
+        else
+        {
+            newIndex[i] = newIndex[remap[i]];
+        }
+    }
+
+    vertexPosition.resize(numUnique);
+    vertexAuxilary.resize(numUnique);
+
+    ParallelFor(indices.size(), [&](uint64 begin, uint64 end)
+    {
+        for (uint64 i = begin; i < end; i++) indices[i] = newIndex[indices[i]];
+    });
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // In the packed layout the vertices are uploaded in (see PackVertices)
+    uint64 saved = uint64(numVertices - numUnique) * (sizeof(glm::vec3) + sizeof(PackedVertexAux));
+    GanymedePrint "Welded", numVertices, "->", numUnique, "vertices in", std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count() * 1000.0, "ms, saved", saved / 1024, "KB of GPU memory";
+}
+
+void PackVertices(const std::vector<glm::vec4>& vertexPosition, const std::vector<VertexAux>& vertexAuxilary, std::vector<glm::vec3>& packedPosition, std::vector<PackedVertexAux>& packedAuxilary)
+{
+    packedPosition.resize(vertexPosition.size());
+    packedAuxilary.resize(vertexAuxilary.size());
+
+    ParallelFor(vertexPosition.size(), [&](uint64 begin, uint64 end)
+    {
+        for (uint64 i = begin; i < end; i++)
+        {
+            packedPosition[i] = glm::vec3(vertexPosition[i]);
+            packedAuxilary[i] = PackedVertexAux{ EncodeOctahedral(vertexAuxilary[i].normal), vertexAuxilary[i].color };
+        }
+    });
+}
+
+void LoadPly(const std::string& file, std::vector<glm::vec4>& vertexPosition, std::vector<VertexAux>& vertexAuxilary, std::vector<uint32>& indices)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    bool mapped = LoadBinaryPly(file, vertexPosition, vertexAuxilary, indices);
+
+    if (!mapped)
+    {
+        vertexPosition.clear();
+        vertexAuxilary.clear();
+        indices.clear();
+
+        HimaliaPlyModel plyModel;
+
+        plyModel.LoadFile(file);
+
+        HimaliaVertexProperty vertexFormatAux[] = {
+            HimaliaVertexProperty::Normal,
+            HimaliaVertexProperty::ColorRGBA8
+        };
+        uint32 alignments[] = {
+            0, offsetof(VertexAux, VertexAux::color)
+        };
+        plyModel.mesh.BuildVertices<VertexAux>(vertexAuxilary, 2, vertexFormatAux, alignments);
+
+        HimaliaVertexProperty vertexFormat = HimaliaVertexProperty::Position;
+        plyModel.mesh.BuildVertices<glm::vec4>(vertexPosition, 1, &vertexFormat);
+
+        plyModel.mesh.BuildIndices<uint32>(indices);
+    }
+
+    // Every later pass indexes the vertex arrays with these unchecked, on the CPU and the GPU.
+    // LoadBinaryPly checked its own while reading.
+    if (!mapped && !indices.empty() && MaxIndex(indices) >= vertexPosition.size())
+    {
+        GanymedePrint file, "has face indices past its", vertexPosition.size(), "vertices";
+        vertexPosition.clear();
+        vertexAuxilary.clear();
+        indices.clear();
+        return;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    GanymedePrint "Loaded", file, "in", std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count() * 1000.0, "ms (", mapped ? "mapped binary" : "Himalia", ")";
+
+    WeldVertices(vertexPosition, vertexAuxilary, indices);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <string>
+#include <vector>
+
+#include "ShaderData.h"
+
+// Parse a PLY scene into the position / aux / index arrays used by the BVH builder and the GPU buffers, duplicate vertices are welded.
+// A file with face indices past its vertex count leaves all three arrays empty.
+void LoadPly(const std::string& file, std::vector<glm::vec4>& vertexPosition, std::vector<VertexAux>& vertexAuxilary, std::vector<uint32>& indices);
+
+// Merges vertices whose position, normal and color agree within the tolerances (compared on a grid of that size)
+// and remaps indices to the compacted arrays. Runs in parallel, keeps the first occurrence of every vertex.
+void WeldVertices(std::vector<glm::vec4>& vertexPosition, std::vector<VertexAux>& vertexAuxilary, std::vector<uint32>& indices, float positionTolerance = 1e-5f, float normalTolerance = 1e-3f);
+
+// Converts to the GPU vertex layout: packed vec3 positions and PackedVertexAux
+void PackVertices(const std::vector<glm::vec4>& vertexPosition, const std::vector<VertexAux>& vertexAuxilary, std::vector<glm::vec3>& packedPosition, std::vector<PackedVertexAux>& packedAuxilary);
@@ -6,12 +6,59 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_precision.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 struct VertexAux
 {
 	glm::vec3 normal;
 	glm::u8vec4 color;
 };
 
+// GPU side vertex attributes (8 bytes): octahedral normal as 2x snorm16 and RGBA8 color.
+// Positions go to the GPU as tightly packed glm::vec3.
+struct PackedVertexAux
+{
+	uint32 normal;
+	glm::u8vec4 color;
+};
+
+// Must match octDecode() in structures.glsl (unpackSnorm2x16, x in the low bits)
+inline uint32 EncodeOctahedral(glm::vec3 n)
+{
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (l1 == 0.0f) return 0; // Missing normal, decodes to +z
+
+	n /= l1;
+
+	glm::vec2 p = glm::vec2(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+		p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	int32 x = int32(std::round(glm::clamp(p.x, -1.0f, 1.0f) * 32767.0f));
+	int32 y = int32(std::round(glm::clamp(p.y, -1.0f, 1.0f) * 32767.0f));
+
+	return (uint32(x) & 0xFFFF) | (uint32(y) << 16);
+}
+
+inline glm::vec3 DecodeOctahedral(uint32 v)
+{
+	glm::vec2 p = glm::vec2(
+		std::max(float(int16(v & 0xFFFF)) / 32767.0f, -1.0f),
+		std::max(float(int16(v >> 16)) / 32767.0f, -1.0f)
+	);
+
+	glm::vec3 n = glm::vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+
+	return glm::normalize(n);
+}
+
 struct ShaderConstants {
 	glm::mat4 viewMtx;
 	glm::mat4 projMtx;
@@ -25,6 +72,15 @@ struct ShaderConstants {
 	uint32 numRays;
 	uint32 numBVHNodes;
 	alignas(16) glm::vec3 ambientRadiance;
+	uint32 numAreaLights;
+	uint32 passDepth; // Path depth of the wavefront passes, one constants copy per depth
+	uint32 forwardAccumulation; // Set when the TraceTargets were created with forwardAccumulation
+	glm::vec2 tileSize; // Pixels of the tile at viewportBase, see GetTraceTiles()
+	uint32 samplesPerFrame; // Paths per pixel traced by each pass, see TraceTargets
+	float convergenceThreshold; // Adaptive sampling, relative error of a converged tile, 0 = off
+	uint32 reproject; // Set on the frames RecordTraceHistory ran, the accumulation restarts from the reprojected history
+	alignas(16) glm::mat4 prevViewMtx; // Matrices the history was rendered with
+	glm::mat4 prevProjMtx;
 };
 
 struct Light
@@ -41,7 +97,84 @@ struct RayStack
 	alignas(8) glm::u16vec3 wIn;
 };
 
+// Forward accumulation: one entry per pixel instead of numRays RayStack entries
+struct PathState
+{
+	alignas(16) glm::vec3 rayOrigin;
+	uint32 randState;
+	glm::vec3 rayDirection;
+	uint32 currentDepth;
+	glm::vec3 throughput;
+	uint32 lastHitDelta;
+	alignas(16) glm::vec3 radiance;
+};
+
 struct RayJob
 {
 	uint32 index;
+};
+
+// Header of the compact.comp state buffer, followed by one look-back status word per 256 job partition
+struct CompactionState
+{
+	uint32 liveCount;
+	uint32 partitionCounter;
+	uint32 workCounter;
+};
+
+#define COMPACTION_GROUP_SIZE 256
+
+// Threads per group of the compacted trace and the radix keys pass, must match compaction.glsl
+#define COMPACTION_TRACE_GROUP_SIZE 64
+
+// radix.glsl: pairs per block, and the digit count stored per block after the two pass counters
+#define RADIX_BLOCK_SIZE 4096
+#define RADIX_DIGITS 256
+#define RADIX_PASSES 4
+
+// Adaptive sampling, pixels per side of the convergence mask tiles (shaders/adaptive.glsl)
+#define CONVERGENCE_TILE_SIZE 8
+
+// Wavefront mode (extend / shade / shadow kernels), must match structures.glsl and wavefront.glsl
+#define WAVEFRONT_MAX_DEPTH 8
+#define WAVEFRONT_GROUP_SIZE 64
+
+// Queue counters, one slot per depth
+struct WavefrontState
+{
+	uint32 extendCount[WAVEFRONT_MAX_DEPTH];
+	uint32 hitCount[WAVEFRONT_MAX_DEPTH];
+	uint32 shadowCount[WAVEFRONT_MAX_DEPTH];
+};
+
+struct WavefrontHit
+{
+	uint32 stackIndex;
+	int32 i1, i2, i3;
+	glm::u16vec4 bary;
+	float t;
+	uint32 leaf;
+};
+
+struct ShadowRay
+{
+	alignas(16) glm::vec3 o;
+	float max_t;
+	glm::vec3 d;
+	uint32 stackIndex;
+	glm::u16vec4 contribution;
+	uint32 origBvhId;
+};
+
+// bvhbuild.comp scratch node, internal nodes first, then one leaf per triangle
+struct BVHBuildNode
+{
+	glm::vec3 a;
+	uint32 parent;
+	glm::vec3 b;
+	uint32 left;
+	uint32 right;
+	uint32 first;
+	uint32 last;
+	uint32 visits;
 };
\ No newline at end of file
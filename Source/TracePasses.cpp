@@ -0,0 +1,689 @@
+#include "TracePasses.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <thread>
+
+#include "trace.comp.h"
+#include "trace_speculative.comp.h"
+#include "trace_compacted.comp.h"
+#include "trace_persistent.comp.h"
+#include "launch.comp.h"
+#include "raysort.comp.h"
+#include "compact.comp.h"
+#include "compact_reset.comp.h"
+#include "radixsort_keys.comp.h"
+#include "radixsort_histogram.comp.h"
+#include "radixsort_scan.comp.h"
+#include "radixsort_scatter.comp.h"
+#include "resolve.comp.h"
+#include "extend.comp.h"
+#include "shade.comp.h"
+#include "shadow.comp.h"
+#include "converge.comp.h"
+#include "history.comp.h"
+
+#include "blueNoise.h"
+
+#include "BVH.h"
+
+void ComputePipelineBatch::Create(const Job& job)
+{
+    EuropaShaderModule::Ref shader;
+    {
+        std::lock_guard<std::mutex> lock(m_shaderLock);
+        shader = m_device->CreateShaderModule(job.code, job.size);
+    }
+
+    EuropaShaderStageInfo stage = { EuropaShaderStageCompute, shader, "main" };
+
+    *job.pipeline = m_device->CreateComputePipeline(stage, m_layout);
+}
+
+void ComputePipelineBatch::Wait()
+{
+    std::vector<Job> jobs;
+    jobs.swap(m_jobs);
+    if (jobs.empty()) return;
+
+    uint32 numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    numWorkers = std::min(numWorkers, uint32(jobs.size()));
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr firstError;
+    std::mutex errorLock;
+
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < jobs.size(); i = next++)
+        {
+            try
+            {
+                Create(jobs[i]);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorLock);
+                if (!firstError) firstError = std::current_exception();
+            }
+        }
+    };
+
+    // The calling thread is one of the workers
+    std::vector<std::thread> threads;
+    for (uint32 i = 1; i < numWorkers; i++) threads.push_back(std::thread(worker));
+    worker();
+    for (std::thread& thread : threads) thread.join();
+
+    if (firstError) std::rethrow_exception(firstError);
+}
+
+TracePipelines CreateTracePipelines(EuropaDevice::Ref device)
+{
+    TracePipelines pipelines;
+
+    pipelines.descLayout = device->CreateDescriptorSetLayout();
+    pipelines.descLayout->DynamicUniformBuffer(0, 1, EuropaShaderStageAll);
+    pipelines.descLayout->Storage(1, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(2, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->BufferViewUniform(3, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(4, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->ImageViewStorage(5, 1, EuropaShaderStageAll);
+    pipelines.descLayout->ImageViewStorage(6, 1, EuropaShaderStageAll);
+    pipelines.descLayout->Storage(7, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(8, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(9, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(10, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(11, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(12, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(13, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(14, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(15, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(16, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(17, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(18, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(19, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(20, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(21, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(22, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(25, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(26, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(27, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->ImageViewStorage(28, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Storage(29, 1, EuropaShaderStageCompute);
+    pipelines.descLayout->Build();
+
+    pipelines.layout = device->CreatePipelineLayout(EuropaPipelineLayoutInfo{ 1, 0, &pipelines.descLayout });
+
+    ComputePipelineBatch batch(device, pipelines.layout);
+    batch.Add(pipelines.trace, shader_spv_trace_comp_h);
+    batch.Add(pipelines.traceSpeculative, shader_spv_trace_speculative_comp_h);
+    batch.Add(pipelines.launch, shader_spv_launch_comp_h);
+    batch.Add(pipelines.raySort, shader_spv_raysort_comp_h);
+    batch.Add(pipelines.resolve, shader_spv_resolve_comp_h);
+    batch.Add(pipelines.compactReset, shader_spv_compact_reset_comp_h);
+    batch.Add(pipelines.compact, shader_spv_compact_comp_h);
+    batch.Add(pipelines.traceCompacted, shader_spv_trace_compacted_comp_h);
+    batch.Add(pipelines.tracePersistent, shader_spv_trace_persistent_comp_h);
+    batch.Add(pipelines.radixKeys, shader_spv_radixsort_keys_comp_h);
+    batch.Add(pipelines.radixHistogram, shader_spv_radixsort_histogram_comp_h);
+    batch.Add(pipelines.radixScan, shader_spv_radixsort_scan_comp_h);
+    batch.Add(pipelines.radixScatter, shader_spv_radixsort_scatter_comp_h);
+    batch.Add(pipelines.extend, shader_spv_extend_comp_h);
+    batch.Add(pipelines.shade, shader_spv_shade_comp_h);
+    batch.Add(pipelines.shadow, shader_spv_shadow_comp_h);
+    batch.Add(pipelines.converge, shader_spv_converge_comp_h);
+    batch.Add(pipelines.history, shader_spv_history_comp_h);
+    batch.Wait();
+
+    return pipelines;
+}
+
+static void CreateStorageImage(EuropaDevice::Ref device, glm::uvec2 size, EuropaImageFormat format, EuropaImage::Ref& image, EuropaImageView::Ref& view)
+{
+    EuropaImageInfo info;
+    info.width = size.x;
+    info.height = size.y;
+    info.initialLayout = EuropaImageLayout::General;
+    info.type = EuropaImageType::Image2D;
+    info.format = format;
+    info.usage = EuropaImageUsage(EuropaImageUsageStorage | EuropaImageUsageTransferSrc | EuropaImageUsageTransferDst);
+    info.memoryUsage = EuropaMemoryUsage::GpuOnly;
+
+    image = device->CreateImage(info);
+
+    EuropaImageViewCreateInfo viewInfo;
+    viewInfo.format = format;
+    viewInfo.image = image;
+    viewInfo.type = EuropaImageViewType::View2D;
+    viewInfo.minArrayLayer = 0;
+    viewInfo.minMipLevel = 0;
+    viewInfo.numArrayLayers = 1;
+    viewInfo.numMipLevels = 1;
+
+    view = device->CreateImageView(viewInfo);
+}
+
+static uint32 CompactionStateSize(uint32 numJobs)
+{
+    uint32 numPartitions = (numJobs + COMPACTION_GROUP_SIZE - 1) / COMPACTION_GROUP_SIZE;
+    return uint32(sizeof(CompactionState) + numPartitions * sizeof(uint32));
+}
+
+static uint32 SortStateSize(uint32 numJobs)
+{
+    uint32 numBlocks = (numJobs + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+    return uint32((2 + numBlocks * RADIX_DIGITS) * sizeof(uint32));
+}
+
+// Paths per pass: samplesPerFrame per pixel of a full tile, the per pixel buffers hold one entry per path
+static uint32 TileJobs(const TraceTargets& targets)
+{
+    return targets.tileSize.x * targets.tileSize.y * targets.samplesPerFrame;
+}
+
+static glm::uvec2 ConvergenceTiles(const TraceTargets& targets)
+{
+    return (targets.size + glm::uvec2(CONVERGENCE_TILE_SIZE - 1)) / glm::uvec2(CONVERGENCE_TILE_SIZE);
+}
+
+static uint32 ConvergenceMaskSize(const TraceTargets& targets)
+{
+    glm::uvec2 tiles = ConvergenceTiles(targets);
+    return uint32(tiles.x * tiles.y * sizeof(uint32));
+}
+
+static uint32 LuminanceMomentsSize(const TraceTargets& targets)
+{
+    return uint32(targets.size.x * targets.size.y * sizeof(float));
+}
+
+// Europa's buffer sizes and descriptor ranges are uint32
+static const uint64 MaxBufferSize = 0xFFFFFFFFull;
+
+static glm::uvec2 HistorySize(const TraceTargets& targets)
+{
+    return targets.reprojection ? targets.size : glm::uvec2(1);
+}
+
+static uint32 PrimaryDepthSize(const TraceTargets& targets)
+{
+    glm::uvec2 size = HistorySize(targets);
+    return uint32(size.x * size.y * sizeof(float));
+}
+
+static uint32 HistorySamplesSize(const TraceTargets& targets)
+{
+    glm::uvec2 size = HistorySize(targets);
+    return uint32(size.x * size.y * sizeof(glm::vec2));
+}
+
+// The unused one of rayStack / pathStates keeps a single entry per pixel so the bindings stay valid
+static uint32 RayStackSize(const TraceTargets& targets)
+{
+    uint32 entries = targets.forwardAccumulation ? 1 : targets.maxDepth;
+    return uint32(TileJobs(targets) * entries * sizeof(RayStack));
+}
+
+static uint32 PathStateSize(const TraceTargets& targets)
+{
+    return uint32(TileJobs(targets) * sizeof(PathState));
+}
+
+TraceTargets CreateTraceTargets(EuropaDevice::Ref device, glm::uvec2 size, uint32 maxDepth, bool forwardAccumulation, glm::uvec2 tileSize, uint32 samplesPerFrame, bool reprojection)
+{
+    TraceTargets targets;
+    targets.size = size;
+    targets.tileSize = tileSize == glm::uvec2(0) ? size : glm::min(tileSize, size);
+    targets.samplesPerFrame = std::max(samplesPerFrame, 1u);
+    targets.maxDepth = maxDepth;
+    targets.forwardAccumulation = forwardAccumulation;
+    targets.reprojection = reprojection;
+
+    // Buffer sizes and bindings are 32 bit. Tiles bound the per path buffers, the per pixel ones grow with the frame.
+    uint64 tileJobs = uint64(targets.tileSize.x) * targets.tileSize.y * targets.samplesPerFrame;
+    uint64 bytesPerJob = std::max<uint64>({ uint64(forwardAccumulation ? 1 : maxDepth) * sizeof(RayStack), sizeof(PathState), sizeof(RayJob),
+        2 * sizeof(glm::uvec2), sizeof(WavefrontHit), sizeof(ShadowRay) });
+    glm::uvec2 historySize = HistorySize(targets);
+    uint64 largest = std::max<uint64>({ tileJobs * bytesPerJob, uint64(size.x) * size.y * sizeof(float), uint64(historySize.x) * historySize.y * sizeof(glm::vec2) });
+    if (largest > MaxBufferSize)
+    {
+        GanymedePrint "Trace targets of", size.x, "x", size.y, "in", targets.tileSize.x, "x", targets.tileSize.y, "tiles need a", largest >> 20, "MB buffer, use smaller tiles";
+        return TraceTargets();
+    }
+
+    uint32 numJobs = TileJobs(targets);
+
+    targets.rayStack = CreateGpuBuffer(device, RayStackSize(targets), EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferSrc));
+    targets.pathStates = CreateGpuBuffer(device, PathStateSize(targets), EuropaBufferUsageStorage);
+    targets.jobs = CreateGpuBuffer(device, uint32(numJobs * sizeof(RayJob)), EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferSrc));
+    // Last shadow ray occluder per pixel
+    targets.occluderCache = CreateGpuBuffer(device, uint32(numJobs * sizeof(uint32)), EuropaBufferUsageStorage);
+
+    targets.liveJobs = CreateGpuBuffer(device, uint32(numJobs * sizeof(RayJob)), EuropaBufferUsageStorage);
+    targets.compactionState = CreateGpuBuffer(device, CompactionStateSize(numJobs), EuropaBufferUsageStorage);
+    // (key, stack index) pairs, two halves
+    targets.sortPairs = CreateGpuBuffer(device, uint32(numJobs * 2 * sizeof(glm::uvec2)), EuropaBufferUsageStorage);
+    targets.sortState = CreateGpuBuffer(device, SortStateSize(numJobs), EuropaBufferUsageStorage);
+
+    // Wavefront queues: every path has at most one ray, hit and shadow ray in flight per depth
+    targets.wavefrontState = CreateGpuBuffer(device, sizeof(WavefrontState), EuropaBufferUsageStorage);
+    targets.rayQueue = CreateGpuBuffer(device, uint32(numJobs * 2 * sizeof(uint32)), EuropaBufferUsageStorage);
+    targets.hitQueue = CreateGpuBuffer(device, uint32(numJobs * sizeof(WavefrontHit)), EuropaBufferUsageStorage);
+    targets.shadowQueue = CreateGpuBuffer(device, uint32(numJobs * sizeof(ShadowRay)), EuropaBufferUsageStorage);
+
+    CreateStorageImage(device, size, EuropaImageFormat::RGBA32F, targets.accumulation, targets.accumulationView);
+    CreateStorageImage(device, size, EuropaImageFormat::RGBA16F, targets.current, targets.currentView);
+
+    targets.luminanceMoments = CreateGpuBuffer(device, LuminanceMomentsSize(targets), EuropaBufferUsageStorage);
+    targets.convergenceMask = CreateGpuBuffer(device, ConvergenceMaskSize(targets), EuropaBufferUsageStorage);
+
+    targets.primaryDepth = CreateGpuBuffer(device, PrimaryDepthSize(targets), EuropaBufferUsageStorage);
+    CreateStorageImage(device, HistorySize(targets), EuropaImageFormat::RGBA32F, targets.history, targets.historyView);
+    targets.historySamples = CreateGpuBuffer(device, HistorySamplesSize(targets), EuropaBufferUsageStorage);
+
+    return targets;
+}
+
+EuropaBuffer::Ref CreateGpuBuffer(EuropaDevice::Ref device, uint32 size, EuropaBufferUsage usage)
+{
+    EuropaBufferInfo info;
+    info.exclusive = true;
+    info.size = size;
+    info.usage = usage;
+    info.memoryUsage = EuropaMemoryUsage::GpuOnly;
+    return device->CreateBuffer(info);
+}
+
+void UploadBlueNoise(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, TraceSceneBuffers& buffers)
+{
+    buffers.blueNoise = CreateGpuBuffer(device, sizeof(_blueNoise), EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.blueNoise, _blueNoise, sizeof(_blueNoise) / sizeof(uint16));
+}
+
+void UploadSceneGeometry(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, const Scene& scene, TraceSceneBuffers& buffers)
+{
+    buffers.auxSize = uint32(scene.numVertices * sizeof(PackedVertexAux));
+    buffers.aux = CreateGpuBuffer(device, buffers.auxSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageVertex | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.aux, scene.aux, scene.numVertices);
+
+    buffers.positionsSize = uint32(scene.numVertices * sizeof(glm::vec3));
+    buffers.positions = CreateGpuBuffer(device, buffers.positionsSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageVertex | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.positions, scene.positions, scene.numVertices);
+
+    uint32 indexSize = uint32(scene.numIndices * sizeof(uint32));
+    buffers.indices = CreateGpuBuffer(device, indexSize, EuropaBufferUsage(EuropaBufferUsageUniformTexel | EuropaBufferUsageIndex | EuropaBufferUsageTransferDst));
+    buffers.indexView = device->CreateBufferView(buffers.indices, indexSize, 0, EuropaImageFormat::RGB32UI);
+    transfer->UploadToBufferEx(buffers.indices, scene.indices, scene.numIndices);
+
+    buffers.nodesSize = uint32(scene.nodes.size() * sizeof(BVHNode));
+    buffers.nodes = CreateGpuBuffer(device, buffers.nodesSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.nodes, scene.nodes.data(), uint32(scene.nodes.size()));
+}
+
+void UploadLights(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, const std::vector<Light>& lights, const std::vector<LightNode>& lightTree, const std::vector<AreaLight>& areaLights, TraceSceneBuffers& buffers)
+{
+    buffers.lightsSize = uint32(lights.size() * sizeof(Light));
+    buffers.lights = CreateGpuBuffer(device, buffers.lightsSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.lights, lights.data(), uint32(lights.size()));
+
+    buffers.lightTreeSize = uint32(lightTree.size() * sizeof(LightNode));
+    buffers.lightTree = CreateGpuBuffer(device, buffers.lightTreeSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.lightTree, lightTree.data(), uint32(lightTree.size()));
+
+    // Keep one unused entry so the buffer is never empty, numAreaLights stays 0
+    std::vector<AreaLight> areaLightData = areaLights;
+    if (areaLightData.empty()) areaLightData.push_back({});
+
+    buffers.areaLightsSize = uint32(areaLightData.size() * sizeof(AreaLight));
+    buffers.areaLights = CreateGpuBuffer(device, buffers.areaLightsSize, EuropaBufferUsage(EuropaBufferUsageStorage | EuropaBufferUsageTransferDst));
+    transfer->UploadToBufferEx(buffers.areaLights, areaLightData.data(), uint32(areaLightData.size()));
+}
+
+void SetTraceDescriptors(EuropaDescriptorSet::Ref set, const TraceSceneBuffers& buffers, const TraceTargets& targets)
+{
+    uint32 numJobs = TileJobs(targets);
+
+    set->SetStorage(buffers.lights, 0, buffers.lightsSize, 1, 0);
+    set->SetStorage(buffers.aux, 0, buffers.auxSize, 2, 0);
+    set->SetBufferViewUniform(buffers.indexView, 3, 0);
+    set->SetStorage(buffers.blueNoise, 0, sizeof(_blueNoise), 4, 0);
+
+    set->SetImageViewStorage(targets.currentView, EuropaImageLayout::General, 5, 0);
+    set->SetImageViewStorage(targets.accumulationView, EuropaImageLayout::General, 6, 0);
+    set->SetStorage(buffers.positions, 0, buffers.positionsSize, 7, 0);
+    set->SetStorage(buffers.nodes, 0, buffers.nodesSize, 8, 0);
+    set->SetStorage(targets.rayStack, 0, RayStackSize(targets), 9, 0);
+    set->SetStorage(targets.jobs, 0, uint32(numJobs * sizeof(RayJob)), 10, 0);
+    set->SetStorage(targets.occluderCache, 0, uint32(numJobs * sizeof(uint32)), 11, 0);
+    set->SetStorage(buffers.lightTree, 0, buffers.lightTreeSize, 12, 0);
+    set->SetStorage(buffers.areaLights, 0, buffers.areaLightsSize, 13, 0);
+    set->SetStorage(targets.wavefrontState, 0, sizeof(WavefrontState), 14, 0);
+    set->SetStorage(targets.rayQueue, 0, uint32(numJobs * 2 * sizeof(uint32)), 15, 0);
+    set->SetStorage(targets.hitQueue, 0, uint32(numJobs * sizeof(WavefrontHit)), 16, 0);
+    set->SetStorage(targets.shadowQueue, 0, uint32(numJobs * sizeof(ShadowRay)), 17, 0);
+    set->SetStorage(targets.liveJobs, 0, uint32(numJobs * sizeof(RayJob)), 18, 0);
+    set->SetStorage(targets.compactionState, 0, CompactionStateSize(numJobs), 19, 0);
+    set->SetStorage(targets.sortPairs, 0, uint32(numJobs * 2 * sizeof(glm::uvec2)), 20, 0);
+    set->SetStorage(targets.sortState, 0, SortStateSize(numJobs), 21, 0);
+    set->SetStorage(targets.pathStates, 0, PathStateSize(targets), 22, 0);
+    set->SetStorage(targets.convergenceMask, 0, ConvergenceMaskSize(targets), 25, 0);
+    set->SetStorage(targets.luminanceMoments, 0, LuminanceMomentsSize(targets), 26, 0);
+    set->SetStorage(targets.primaryDepth, 0, PrimaryDepthSize(targets), 27, 0);
+    set->SetImageViewStorage(targets.historyView, EuropaImageLayout::General, 28, 0);
+    set->SetStorage(targets.historySamples, 0, HistorySamplesSize(targets), 29, 0);
+}
+
+static void ComputeBarrier(EuropaCmdlist::Ref cmdlist, EuropaBuffer::Ref buffer, uint32 size)
+{
+    cmdlist->Barrier(
+        buffer, size, 0,
+        EuropaAccessShaderWrite, EuropaAccessShaderRead,
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+}
+
+// The next pass reads the counters and appends to the queues of the following ones
+static void WavefrontStateBarrier(EuropaCmdlist::Ref cmdlist, const TraceTargets& targets)
+{
+    cmdlist->Barrier(
+        targets.wavefrontState, sizeof(WavefrontState), 0,
+        EuropaAccessShaderWrite, EuropaAccess(EuropaAccessShaderRead | EuropaAccessShaderWrite),
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+}
+
+// Workgroups covering every job of the tile. The passes over queues and live jobs are sized with it and their
+// groups past the GPU side count return right away, there is no indirect dispatch in Europa.
+static uint32 GroupsFor(uint32 jobs, uint32 groupSize)
+{
+    return (jobs + groupSize - 1) / groupSize;
+}
+
+// Lets options.passCallback split the command list after a pass, a new list needs the descriptor set bound again
+static void EndPass(EuropaCmdlist::Ref& cmdlist, const TracePipelines& pipelines, EuropaDescriptorSet::Ref set, uint32 constantsOffset, const TracePassOptions& options, const char* pass, uint32 depth)
+{
+    if (!options.passCallback) return;
+
+    options.passCallback(cmdlist, pass, depth);
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset);
+}
+
+// Packs the live jobGrid entries of the tile into liveJobs and counts them in liveCount
+static void RecordCompaction(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, uint32 tilePixels)
+{
+    uint32 numJobs = TileJobs(targets);
+    uint32 stateSize = CompactionStateSize(numJobs);
+
+    ComputeBarrier(cmdlist, targets.jobs, uint32(numJobs * sizeof(RayJob)));
+    ComputeBarrier(cmdlist, targets.compactionState, stateSize);
+
+    cmdlist->BindCompute(pipelines.compactReset);
+    cmdlist->Dispatch(1, 1, 1);
+
+    ComputeBarrier(cmdlist, targets.compactionState, stateSize);
+
+    cmdlist->BindCompute(pipelines.compact);
+    cmdlist->Dispatch((tilePixels + COMPACTION_GROUP_SIZE - 1) / COMPACTION_GROUP_SIZE, 1, 1);
+
+    ComputeBarrier(cmdlist, targets.compactionState, stateSize);
+    ComputeBarrier(cmdlist, targets.liveJobs, uint32(numJobs * sizeof(RayJob)));
+}
+
+// Sorts liveJobs by ray key, RADIX_PASSES rounds of histogram -> scan -> scatter over the tileJobs the compaction may have kept
+static void RecordRadixSort(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, uint32 tileJobs)
+{
+    uint32 numJobs = TileJobs(targets);
+    uint32 pairsSize = uint32(numJobs * 2 * sizeof(glm::uvec2));
+    uint32 stateSize = SortStateSize(numJobs);
+
+    ComputeBarrier(cmdlist, targets.sortState, stateSize);
+
+    cmdlist->BindCompute(pipelines.radixKeys);
+    cmdlist->Dispatch(GroupsFor(tileJobs, COMPACTION_TRACE_GROUP_SIZE), 1, 1);
+
+    for (uint32 pass = 0; pass < RADIX_PASSES; pass++)
+    {
+        ComputeBarrier(cmdlist, targets.sortPairs, pairsSize);
+        ComputeBarrier(cmdlist, targets.sortState, stateSize);
+
+        cmdlist->BindCompute(pipelines.radixHistogram);
+        cmdlist->Dispatch(GroupsFor(tileJobs, RADIX_BLOCK_SIZE), 1, 1);
+
+        ComputeBarrier(cmdlist, targets.sortState, stateSize);
+
+        cmdlist->BindCompute(pipelines.radixScan);
+        cmdlist->Dispatch(1, 1, 1);
+
+        ComputeBarrier(cmdlist, targets.sortState, stateSize);
+
+        cmdlist->BindCompute(pipelines.radixScatter);
+        cmdlist->Dispatch(GroupsFor(tileJobs, RADIX_BLOCK_SIZE), 1, 1);
+    }
+
+    ComputeBarrier(cmdlist, targets.liveJobs, uint32(numJobs * sizeof(RayJob)));
+}
+
+static void RecordWavefrontPasses(EuropaCmdlist::Ref& cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, uint32 constantsOffset, const TracePassOptions& options, uint32 tileJobs)
+{
+    uint32 constantsStride = options.constantsStride;
+    uint32 numGroups = GroupsFor(tileJobs, WAVEFRONT_GROUP_SIZE);
+    uint32 numJobs = TileJobs(targets);
+    uint32 rayStackSize = RayStackSize(targets);
+    uint32 maxDepth = std::min(targets.maxDepth, uint32(WAVEFRONT_MAX_DEPTH));
+
+    for (uint32 d = 0; d < maxDepth; d++)
+    {
+        // passDepth comes from the constants copy of this depth
+        cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset + d * constantsStride);
+
+        WavefrontStateBarrier(cmdlist, targets);
+        ComputeBarrier(cmdlist, targets.rayStack, rayStackSize);
+        ComputeBarrier(cmdlist, targets.rayQueue, uint32(numJobs * 2 * sizeof(uint32)));
+
+        cmdlist->BindCompute(pipelines.extend);
+        cmdlist->Dispatch(numGroups, 1, 1);
+        EndPass(cmdlist, pipelines, set, constantsOffset + d * constantsStride, options, "extend", d);
+
+        WavefrontStateBarrier(cmdlist, targets);
+        ComputeBarrier(cmdlist, targets.hitQueue, uint32(numJobs * sizeof(WavefrontHit)));
+
+        cmdlist->BindCompute(pipelines.shade);
+        cmdlist->Dispatch(numGroups, 1, 1);
+        EndPass(cmdlist, pipelines, set, constantsOffset + d * constantsStride, options, "shade", d);
+
+        WavefrontStateBarrier(cmdlist, targets);
+        ComputeBarrier(cmdlist, targets.rayStack, rayStackSize);
+        ComputeBarrier(cmdlist, targets.shadowQueue, uint32(numJobs * sizeof(ShadowRay)));
+
+        cmdlist->BindCompute(pipelines.shadow);
+        cmdlist->Dispatch(numGroups, 1, 1);
+        EndPass(cmdlist, pipelines, set, constantsOffset + d * constantsStride, options, "shadow", d);
+    }
+
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset);
+}
+
+std::vector<TraceTile> GetTraceTiles(const TraceTargets& targets)
+{
+    std::vector<TraceTile> tiles;
+
+    for (uint32 y = 0; y < targets.size.y; y += targets.tileSize.y)
+    {
+        for (uint32 x = 0; x < targets.size.x; x += targets.tileSize.x)
+        {
+            glm::uvec2 base = glm::uvec2(x, y);
+            tiles.push_back({ base, glm::min(targets.tileSize, targets.size - base) });
+        }
+    }
+
+    return tiles;
+}
+
+uint32 GetTraceConstantCopies(const TraceTargets& targets, const TracePassOptions& options)
+{
+    bool wavefront = options.wavefront && !targets.forwardAccumulation;
+    return wavefront ? std::min(targets.maxDepth, uint32(WAVEFRONT_MAX_DEPTH)) : 1;
+}
+
+void WriteTraceConstants(uint8* dst, uint32 stride, const ShaderConstants& constants, const std::vector<TraceTile>& tiles, uint32 numDepthCopies, uint32 samplesPerFrame)
+{
+    for (uint32 t = 0; t < tiles.size(); t++)
+    {
+        for (uint32 d = 0; d < numDepthCopies; d++)
+        {
+            ShaderConstants* copy = reinterpret_cast<ShaderConstants*>(dst + (t * numDepthCopies + d) * stride);
+            *copy = constants;
+            copy->viewportBase = glm::vec2(tiles[t].base);
+            copy->tileSize = glm::vec2(tiles[t].size);
+            copy->samplesPerFrame = samplesPerFrame;
+            copy->passDepth = d;
+        }
+    }
+}
+
+void RecordTracePasses(EuropaCmdlist::Ref& cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, const TraceTile& tile, uint32 constantsOffset, const TracePassOptions& options)
+{
+    glm::uvec2 size = tile.size;
+    // The samples of a pixel are extra tile high bands of the job grid, see jobCount() in structures.glsl
+    uint32 jobRows = size.y * targets.samplesPerFrame;
+    uint32 rayStackSize = RayStackSize(targets);
+    bool wavefront = options.wavefront && !targets.forwardAccumulation;
+    uint32 jobsSize = uint32(TileJobs(targets) * sizeof(RayJob));
+
+    // The previous tile's resolve still reads the ray state this launch overwrites
+    ComputeBarrier(cmdlist, targets.rayStack, rayStackSize);
+    ComputeBarrier(cmdlist, targets.pathStates, PathStateSize(targets));
+
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset);
+    cmdlist->BindCompute(pipelines.launch);
+    cmdlist->Dispatch(uint32(ceil(float(size.x) / 32.0f)), uint32(ceil(float(size.y) / 32.0f)), targets.samplesPerFrame);
+    EndPass(cmdlist, pipelines, set, constantsOffset, options, "launch", 0);
+
+    if (wavefront)
+    {
+        RecordWavefrontPasses(cmdlist, pipelines, targets, set, constantsOffset, options, size.x * jobRows);
+    }
+
+    for (uint32 d = 0; d < targets.maxDepth && !wavefront; d++)
+    {
+        cmdlist->Barrier(
+            targets.rayStack, rayStackSize, 0,
+            EuropaAccessShaderWrite, EuropaAccessShaderRead,
+            EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+        );
+        ComputeBarrier(cmdlist, targets.pathStates, PathStateSize(targets));
+
+        if (d > 0 && options.compaction)
+        {
+            RecordCompaction(cmdlist, pipelines, targets, size.x * jobRows);
+            EndPass(cmdlist, pipelines, set, constantsOffset, options, "compaction", d);
+
+            if (options.raySort)
+            {
+                RecordRadixSort(cmdlist, pipelines, targets, size.x * jobRows);
+                EndPass(cmdlist, pipelines, set, constantsOffset, options, "raysort", d);
+            }
+
+            if (options.persistentGroups > 0)
+            {
+                cmdlist->BindCompute(pipelines.tracePersistent);
+                cmdlist->Dispatch(options.persistentGroups, 1, 1);
+            }
+            else
+            {
+                cmdlist->BindCompute(pipelines.traceCompacted);
+                cmdlist->Dispatch(GroupsFor(size.x * jobRows, COMPACTION_TRACE_GROUP_SIZE), 1, 1);
+            }
+            EndPass(cmdlist, pipelines, set, constantsOffset, options, "trace", d);
+            continue;
+        }
+
+        if (d == 0)
+            cmdlist->BindCompute(pipelines.traceSpeculative);
+        else
+            cmdlist->BindCompute(pipelines.trace);
+
+        cmdlist->Dispatch(uint32(ceil(float(size.x) / 8.0f)), uint32(ceil(float(jobRows) / 8.0f)), 1);
+        EndPass(cmdlist, pipelines, set, constantsOffset, options, "trace", d);
+
+        if (options.raySort && !options.compaction && d != targets.maxDepth - 1)
+        {
+            cmdlist->Barrier(
+                targets.jobs, jobsSize, 0,
+                EuropaAccessShaderWrite, EuropaAccessShaderRead,
+                EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+            );
+
+            cmdlist->BindCompute(pipelines.raySort);
+            cmdlist->Dispatch(uint32(ceil(float(size.x) / 256.0f)), jobRows, 1);
+            EndPass(cmdlist, pipelines, set, constantsOffset, options, "raysort", d);
+
+            cmdlist->Barrier(
+                targets.jobs, jobsSize, 0,
+                EuropaAccessShaderWrite, EuropaAccessShaderRead,
+                EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+            );
+        }
+    }
+
+    cmdlist->Barrier(
+        targets.rayStack, rayStackSize, 0,
+        EuropaAccessShaderWrite, EuropaAccessShaderRead,
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+
+    ComputeBarrier(cmdlist, targets.pathStates, PathStateSize(targets));
+
+    cmdlist->BindCompute(pipelines.resolve);
+    cmdlist->Dispatch(uint32(ceil(float(size.x) / 8.0f)), uint32(ceil(float(size.y) / 8.0f)), 1);
+    EndPass(cmdlist, pipelines, set, constantsOffset, options, "resolve", 0);
+}
+
+void RecordConvergence(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, uint32 constantsOffset)
+{
+    glm::uvec2 tiles = ConvergenceTiles(targets);
+
+    cmdlist->Barrier(
+        targets.accumulation,
+        EuropaAccessShaderWrite, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+    ComputeBarrier(cmdlist, targets.luminanceMoments, LuminanceMomentsSize(targets));
+
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset);
+    cmdlist->BindCompute(pipelines.converge);
+    cmdlist->Dispatch(tiles.x, tiles.y, 1);
+
+    // Read by the next frame's launch and resolve
+    ComputeBarrier(cmdlist, targets.convergenceMask, ConvergenceMaskSize(targets));
+}
+
+void RecordTraceHistory(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, uint32 constantsOffset)
+{
+    if (!targets.reprojection) return;
+
+    // The accumulation may come from a resolve or a clear
+    cmdlist->Barrier(
+        targets.accumulation,
+        EuropaAccess(EuropaAccessShaderWrite | EuropaAccessTransferWrite), EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+        EuropaPipelineStage(EuropaPipelineStageComputeShader | EuropaPipelineStageTransfer), EuropaPipelineStageComputeShader
+    );
+    ComputeBarrier(cmdlist, targets.primaryDepth, PrimaryDepthSize(targets));
+    ComputeBarrier(cmdlist, targets.luminanceMoments, LuminanceMomentsSize(targets));
+
+    cmdlist->BindDescriptorSetsDynamicOffsets(EuropaPipelineBindPoint::Compute, pipelines.layout, set, 0, constantsOffset);
+    cmdlist->BindCompute(pipelines.history);
+    cmdlist->Dispatch(uint32(ceil(float(targets.size.x) / 8.0f)), uint32(ceil(float(targets.size.y) / 8.0f)), 1);
+
+    // Read by resolve, which also overwrites the accumulation this pass read
+    cmdlist->Barrier(
+        targets.history,
+        EuropaAccessShaderWrite, EuropaAccessShaderRead, EuropaImageLayout::General, EuropaImageLayout::General,
+        EuropaPipelineStageComputeShader, EuropaPipelineStageComputeShader
+    );
+    ComputeBarrier(cmdlist, targets.historySamples, HistorySamplesSize(targets));
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include "Europa/Source/Europa.h"
+#include "Ganymede/Source/Ganymede.h"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "ShaderData.h"
+#include "LightTree.h"
+#include "SceneCache.h"
+
+// Compute side of the renderer, shared by the app and PathTracerHeadless:
+//   launch -> (trace, raysort) per depth -> resolve, which adds the sample to the accumulation image.
+// With compaction the bounces after the first trace only the live jobs, packed by compact.comp,
+// and the ray sort is a radix sort of those jobs by direction octant and origin Morton code (radixsort.comp).
+// The wavefront mode replaces the trace megakernel with extend -> shade -> shadow per depth, each dispatched for the whole
+// tile and bounded by the queue counters of wavefront.glsl.
+// Adaptive sampling (convergenceThreshold > 0) adds a frame wide converge pass after all tiles, whose tile mask makes
+// launch skip the pixels of converged tiles in the next frame.
+// On camera motion RecordTraceHistory snapshots the accumulation first, and resolve reprojects it (reproject.glsl).
+// All passes use one descriptor set layout, binding 0 is the dynamic ShaderConstants uniform.
+
+struct TracePipelines
+{
+    EuropaDescriptorSetLayout::Ref descLayout;
+    EuropaPipelineLayout::Ref layout;
+
+    EuropaPipeline::Ref launch;
+    EuropaPipeline::Ref trace;
+    EuropaPipeline::Ref traceSpeculative;
+    EuropaPipeline::Ref raySort;
+    EuropaPipeline::Ref resolve;
+
+    EuropaPipeline::Ref compactReset;
+    EuropaPipeline::Ref compact;
+    EuropaPipeline::Ref traceCompacted;
+    EuropaPipeline::Ref tracePersistent;
+
+    EuropaPipeline::Ref radixKeys;
+    EuropaPipeline::Ref radixHistogram;
+    EuropaPipeline::Ref radixScan;
+    EuropaPipeline::Ref radixScatter;
+
+    EuropaPipeline::Ref extend;
+    EuropaPipeline::Ref shade;
+    EuropaPipeline::Ref shadow;
+
+    EuropaPipeline::Ref converge;
+    EuropaPipeline::Ref history;
+};
+
+// Per resolution buffers and images. The images cover the whole frame, the per pixel buffers one tile: the frame is
+// rendered tile by tile (GetTraceTiles) so ray state memory stays bounded at any resolution.
+// With samplesPerFrame > 1 every pass traces that many independent paths per pixel, the per pixel buffers hold one
+// entry per path and resolve adds all of them to the accumulation image.
+struct TraceTargets
+{
+    glm::uvec2 size = glm::uvec2(0);
+    glm::uvec2 tileSize = glm::uvec2(0);
+    uint32 samplesPerFrame = 1;
+    uint32 maxDepth = 0;
+    // Paths carry throughput and radiance in pathStates instead of the per depth rayStack, which then has one entry
+    // per pixel. The wavefront passes need the stack and fall back to the megakernel.
+    bool forwardAccumulation = false;
+
+    EuropaBuffer::Ref rayStack;
+    EuropaBuffer::Ref pathStates;
+    EuropaBuffer::Ref jobs;
+    EuropaBuffer::Ref occluderCache;
+
+    EuropaBuffer::Ref liveJobs;
+    EuropaBuffer::Ref compactionState; // CompactionState
+    EuropaBuffer::Ref sortPairs;
+    EuropaBuffer::Ref sortState;
+
+    EuropaBuffer::Ref wavefrontState; // WavefrontState
+    EuropaBuffer::Ref rayQueue;
+    EuropaBuffer::Ref hitQueue;
+    EuropaBuffer::Ref shadowQueue;
+
+    EuropaImage::Ref accumulation; // RGBA32F, sum of samples in rgb and the sample count in a
+    EuropaImageView::Ref accumulationView;
+    EuropaImage::Ref current; // RGBA16F, last sample
+    EuropaImageView::Ref currentView;
+
+    // Frame sized, see adaptive.glsl
+    EuropaBuffer::Ref luminanceMoments;
+    EuropaBuffer::Ref convergenceMask; // One uint per CONVERGENCE_TILE_SIZE squared tile
+    // The mask starts out uninitialized and goes stale while frames run without a converge pass. Until a converge pass
+    // ran, frames need convergenceThreshold 0: launch and resolve then ignore the mask and converge writes it all zero.
+    bool convergenceMaskValid = false;
+
+    // Frame sized, see reproject.glsl. Without reprojection they hold a single pixel so the bindings stay valid,
+    // RecordTraceHistory does nothing and ShaderConstants::reproject has to stay 0.
+    bool reprojection = false;
+    EuropaBuffer::Ref primaryDepth;
+    EuropaImage::Ref history; // RGBA32F, accumulation of the previous view
+    EuropaImageView::Ref historyView;
+    EuropaBuffer::Ref historySamples;
+};
+
+// GPU copies of the scene, sizes are in bytes
+struct TraceSceneBuffers
+{
+    EuropaBuffer::Ref positions;
+    EuropaBuffer::Ref aux;
+    EuropaBuffer::Ref indices;
+    EuropaBufferView::Ref indexView;
+    EuropaBuffer::Ref nodes;
+    EuropaBuffer::Ref lights;
+    EuropaBuffer::Ref lightTree;
+    EuropaBuffer::Ref areaLights;
+    EuropaBuffer::Ref blueNoise;
+
+    uint32 positionsSize = 0;
+    uint32 auxSize = 0;
+    uint32 nodesSize = 0;
+    uint32 lightsSize = 0;
+    uint32 lightTreeSize = 0;
+    uint32 areaLightsSize = 0;
+};
+
+// Creates the compute pipelines of one layout on min(hardware threads, pipelines) workers, shader compilation in the
+// driver dominates startup. Add() only queues a pipeline, they are all set once Wait() returned.
+// Only EuropaDevice::CreateComputePipeline runs concurrently: it is a single vkCreateComputePipelines call, which needs no
+// external synchronization of the device. Shader modules are created under a lock.
+class ComputePipelineBatch
+{
+public:
+    ComputePipelineBatch(EuropaDevice::Ref device, EuropaPipelineLayout::Ref layout) : m_device(device), m_layout(layout) {}
+
+    // code is embedded SPIR-V, it and pipeline must stay valid until Wait()
+    template <typename T, size_t N>
+    void Add(EuropaPipeline::Ref& pipeline, const T (&code)[N])
+    {
+        m_jobs.push_back({ &pipeline, code, sizeof(code) });
+    }
+
+    // Rethrows the first exception of a worker after all of them finished
+    void Wait();
+
+private:
+    struct Job
+    {
+        EuropaPipeline::Ref* pipeline;
+        const void* code;
+        size_t size;
+    };
+
+    void Create(const Job& job);
+
+    EuropaDevice::Ref m_device;
+    EuropaPipelineLayout::Ref m_layout;
+    std::vector<Job> m_jobs;
+
+    std::mutex m_shaderLock;
+};
+
+TracePipelines CreateTracePipelines(EuropaDevice::Ref device);
+// tileSize 0 renders the frame as one tile. reprojection allocates the frame sized history for RecordTraceHistory.
+// Returns empty targets (no accumulation) when a buffer would not fit 32 bit sizes.
+TraceTargets CreateTraceTargets(EuropaDevice::Ref device, glm::uvec2 size, uint32 maxDepth, bool forwardAccumulation = false, glm::uvec2 tileSize = glm::uvec2(0), uint32 samplesPerFrame = 1, bool reprojection = true);
+
+EuropaBuffer::Ref CreateGpuBuffer(EuropaDevice::Ref device, uint32 size, EuropaBufferUsage usage);
+
+void UploadBlueNoise(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, TraceSceneBuffers& buffers);
+void UploadSceneGeometry(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, const Scene& scene, TraceSceneBuffers& buffers);
+// areaLights may be empty, the buffer then holds one unused entry
+void UploadLights(EuropaDevice::Ref device, EuropaTransferUtil::Ref transfer, const std::vector<Light>& lights, const std::vector<LightNode>& lightTree, const std::vector<AreaLight>& areaLights, TraceSceneBuffers& buffers);
+
+// Bindings 1 - 22 and 25 - 29
+void SetTraceDescriptors(EuropaDescriptorSet::Ref set, const TraceSceneBuffers& buffers, const TraceTargets& targets);
+
+// Called after each pass was recorded. May replace cmdlist to split the frame into several submissions (PassProfiler),
+// the passes rebind their state on the new list.
+typedef std::function<void(EuropaCmdlist::Ref& cmdlist, const char* pass, uint32 depth)> TracePassCallback;
+
+struct TracePassOptions
+{
+    // Sorts the live jobs by ray key with compaction, otherwise only compacts them per row segment
+    bool raySort = true;
+    bool compaction = false;
+    // With compaction: trace with this many persistent workgroups pulling jobs from a global counter, 0 = off
+    uint32 persistentGroups = 0;
+    // Needs GetTraceConstantCopies() ShaderConstants copies, constantsStride apart, with passDepth set to their depth
+    bool wavefront = false;
+    uint32 constantsStride = 0;
+    TracePassCallback passCallback;
+};
+
+struct TraceTile
+{
+    glm::uvec2 base;
+    glm::uvec2 size; // Clipped to the frame
+};
+
+// Row major, each tile needs its own ShaderConstants with viewportBase = base and tileSize = size
+std::vector<TraceTile> GetTraceTiles(const TraceTargets& targets);
+
+// ShaderConstants copies RecordTracePasses reads per tile: one per depth for the wavefront passes, otherwise one
+uint32 GetTraceConstantCopies(const TraceTargets& targets, const TracePassOptions& options);
+
+// Writes the copies of all tiles, stride bytes apart: tile t, depth d at (t * numDepthCopies + d) * stride.
+// samplesPerFrame must be the one of the targets.
+void WriteTraceConstants(uint8* dst, uint32 stride, const ShaderConstants& constants, const std::vector<TraceTile>& tiles, uint32 numDepthCopies, uint32 samplesPerFrame);
+
+// Records all passes for targets.samplesPerFrame samples per pixel of the tile, the accumulation image is left in General layout.
+// Paths run to targets.maxDepth, ShaderConstants::numRays has to match it since it strides the ray stack.
+// cmdlist is where recording continues, options.passCallback may have replaced it.
+void RecordTracePasses(EuropaCmdlist::Ref& cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, const TraceTile& tile, uint32 constantsOffset, const TracePassOptions& options);
+
+// Updates the convergence mask from the accumulation of all tiles, once per frame after their RecordTracePasses.
+// Only needed with ShaderConstants::convergenceThreshold > 0.
+void RecordConvergence(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, uint32 constantsOffset);
+
+// Snapshots the accumulation before the trace passes of a frame whose camera moved. That frame's ShaderConstants need
+// reproject = 1 and the matrices of the previous frame in prevViewMtx / prevProjMtx.
+void RecordTraceHistory(EuropaCmdlist::Ref cmdlist, const TracePipelines& pipelines, const TraceTargets& targets, EuropaDescriptorSet::Ref set, uint32 constantsOffset);
@@ -0,0 +1,272 @@
+#include "Tracer.h"
+#include "TracerWide.h"
+
+#include <algorithm>
+#include <limits>
+
+bool IntersectBBox(const Ray& r, glm::vec3 a, glm::vec3 b)
+{
+    glm::vec3 t0 = (a - r.o) * r.rcpD;
+    glm::vec3 t1 = (b - r.o) * r.rcpD;
+
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+
+    float tmin = std::max(tNear.x, std::max(tNear.y, tNear.z));
+    float tmax = std::min(tFar.x, std::min(tFar.y, tFar.z));
+
+    return (tmax > 0.0f || tmin > 0.0f) && tmax >= tmin && r.min_t < tmax && r.max_t > tmin;
+}
+
+bool Intersect(Ray& r, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, Intersection& isect)
+{
+    glm::vec3 e1 = p2 - p1;
+    glm::vec3 e2 = p3 - p1;
+    glm::vec3 s = r.o - p1, s1 = glm::cross(r.d, e2), s2 = glm::cross(s, e1);
+    glm::vec3 matrix = glm::vec3(glm::dot(s2, e2), glm::dot(s1, s), glm::dot(s2, r.d));
+    glm::vec3 intersection = matrix / glm::dot(s1, e1);
+
+    float t = intersection.x;
+    float alpha = intersection.y;
+    float beta = intersection.z;
+    float gamma = 1.0f - alpha - beta;
+
+    if (t < r.min_t || t > r.max_t || alpha < 0.0f || beta < 0.0f || gamma < 0.0f) return false;
+
+    r.max_t = t;
+
+    isect.bary = glm::vec3(gamma, alpha, beta);
+
+    return true;
+}
+
+bool IntersectTriangles(Ray& r, const TriangleBlock4& block, Intersection& isect)
+{
+#ifdef TRACER_SSE
+    return IntersectTrianglesWide<LanesSSE>(r, block, isect);
+#else
+    return IntersectTrianglesWide<LanesGeneric<4>>(r, block, isect);
+#endif
+}
+
+bool IntersectTriangles(Ray& r, const TriangleBlock8& block, Intersection& isect)
+{
+#ifdef __AVX__
+    return IntersectTrianglesWide<LanesAVX>(r, block, isect);
+#else
+    return IntersectTrianglesWide<LanesGeneric<8>>(r, block, isect);
+#endif
+}
+
+bool OccludedTriangles(const Ray& r, const TriangleBlock4& block)
+{
+#ifdef TRACER_SSE
+    return OccludedWide<LanesSSE>(r, block);
+#else
+    return OccludedWide<LanesGeneric<4>>(r, block);
+#endif
+}
+
+bool OccludedTriangles(const Ray& r, const TriangleBlock8& block)
+{
+#ifdef __AVX__
+    return OccludedWide<LanesAVX>(r, block);
+#else
+    return OccludedWide<LanesGeneric<8>>(r, block);
+#endif
+}
+
+typedef TriangleBlock<TRACER_BLOCK_WIDTH> TracerBlock;
+
+inline void GatherTriangle(TracerBlock& block, uint32 lane, const std::vector<glm::vec4>& vertices, const std::vector<uint32>& indices, uint32 start)
+{
+    glm::vec4 p1 = vertices[indices[start]];
+    glm::vec4 p2 = vertices[indices[start + 1]];
+    glm::vec4 p3 = vertices[indices[start + 2]];
+
+    for (uint32 k = 0; k < 3; k++)
+    {
+        block.p1[k][lane] = p1[k];
+        block.p2[k][lane] = p2[k];
+        block.p3[k][lane] = p3[k];
+    }
+
+    block.triangle[lane] = int32(start);
+}
+
+bool TraceRay(const std::vector<BVHNode>& nodes, const std::vector<glm::vec4>& vertices, const std::vector<uint32>& indices, Ray& r, Intersection& isect, TraceStats* stats)
+{
+    bool hit = false;
+
+    uint64 nodesVisited = 0;
+    uint64 trianglesTested = 0;
+
+    TracerBlock block;
+    uint32 numCandidates = 0;
+
+    // Leaves are not tested right away: their triangles are collected until a block is full.
+    // Boxes in between are culled against a slightly stale max_t, which costs some culling but never correctness.
+    auto flush = [&]()
+    {
+        if (numCandidates == 0) return;
+
+        for (uint32 lane = numCandidates; lane < TRACER_BLOCK_WIDTH; lane++)
+        {
+            block.triangle[lane] = -1;
+            for (uint32 k = 0; k < 3; k++)
+            {
+                block.p1[k][lane] = block.p2[k][lane] = block.p3[k][lane] = 0.0f;
+            }
+        }
+
+        if (IntersectTriangles(r, block, isect)) hit = true;
+
+        trianglesTested += numCandidates;
+        numCandidates = 0;
+    };
+
+    uint32 index = 0;
+
+    while (index < nodes.size())
+    {
+        const BVHNode& node = nodes[index];
+        nodesVisited++;
+
+        if (IntersectBBox(r, node.a, node.b))
+        {
+            if (node.right <= 0)
+            {
+                // Leaf node
+                GatherTriangle(block, numCandidates, vertices, indices, uint32(-node.right));
+                if (++numCandidates == TRACER_BLOCK_WIDTH) flush();
+            }
+
+            index++;
+        }
+        else
+        {
+            index = uint32(node.next);
+            if (index == 0) break;
+        }
+    }
+
+    flush();
+
+    if (stats)
+    {
+        stats->nodesVisited += nodesVisited;
+        stats->trianglesTested += trianglesTested;
+    }
+
+    if (hit)
+    {
+        isect.i1 = int32(indices[isect.triangle]);
+        isect.i2 = int32(indices[isect.triangle + 1]);
+        isect.i3 = int32(indices[isect.triangle + 2]);
+    }
+
+    return hit;
+}
+
+bool TraceOcclusion(const std::vector<BVHNode>& nodes, const std::vector<glm::vec4>& vertices, const std::vector<uint32>& indices, const Ray& r, uint32* occluder, TraceStats* stats)
+{
+    TracerBlock block;
+    uint32 numCandidates = 0;
+
+    uint64 nodesVisited = 0;
+    uint64 trianglesTested = 0;
+
+    auto finish = [&](bool occluded)
+    {
+        if (stats)
+        {
+            stats->nodesVisited += nodesVisited;
+            stats->trianglesTested += trianglesTested;
+        }
+
+        return occluded;
+    };
+
+    auto clearLanes = [&](uint32 from)
+    {
+        for (uint32 lane = from; lane < TRACER_BLOCK_WIDTH; lane++)
+        {
+            block.triangle[lane] = -1;
+            for (uint32 k = 0; k < 3; k++)
+            {
+                block.p1[k][lane] = block.p2[k][lane] = block.p3[k][lane] = 0.0f;
+            }
+        }
+    };
+
+    if (occluder && *occluder != 0 && *occluder < nodes.size() && nodes[*occluder].right <= 0)
+    {
+        GatherTriangle(block, 0, vertices, indices, uint32(-nodes[*occluder].right));
+        clearLanes(1);
+
+        trianglesTested++;
+        if (OccludedTriangles(r, block)) return finish(true);
+    }
+
+    // Leaf indices of the gathered lanes, so the occluder can be cached
+    uint32 leaves[TRACER_BLOCK_WIDTH];
+
+    auto flush = [&]()
+    {
+        if (numCandidates == 0) return false;
+
+        clearLanes(numCandidates);
+
+        bool occluded = OccludedTriangles(r, block);
+        trianglesTested += numCandidates;
+
+        if (occluded && occluder)
+        {
+            // The kernel only reports that some lane hit, narrow it down to cache a single leaf
+            for (uint32 lane = 0; lane < numCandidates; lane++)
+            {
+                Ray rLane = r;
+                Intersection isect;
+                if (Intersect(rLane,
+                    glm::vec3(block.p1[0][lane], block.p1[1][lane], block.p1[2][lane]),
+                    glm::vec3(block.p2[0][lane], block.p2[1][lane], block.p2[2][lane]),
+                    glm::vec3(block.p3[0][lane], block.p3[1][lane], block.p3[2][lane]),
+                    isect))
+                {
+                    *occluder = leaves[lane];
+                    break;
+                }
+            }
+        }
+
+        numCandidates = 0;
+        return occluded;
+    };
+
+    uint32 index = 0;
+
+    while (index < nodes.size())
+    {
+        const BVHNode& node = nodes[index];
+        nodesVisited++;
+
+        if (IntersectBBox(r, node.a, node.b))
+        {
+            if (node.right <= 0)
+            {
+                leaves[numCandidates] = index;
+                GatherTriangle(block, numCandidates, vertices, indices, uint32(-node.right));
+                if (++numCandidates == TRACER_BLOCK_WIDTH && flush()) return finish(true);
+            }
+
+            index++;
+        }
+        else
+        {
+            index = uint32(node.next);
+            if (index == 0) break;
+        }
+    }
+
+    return finish(flush());
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Ganymede/Source/Ganymede.h>
+
+#include <vector>
+
+#include "ShaderData.h"
+#include "BVH.h"
+
+#if defined(__AVX__)
+#define TRACER_BLOCK_WIDTH 8
+#else
+#define TRACER_BLOCK_WIDTH 4
+#endif
+
+// CPU side mirror of the Ray / Intersection structures in shaders/structures.glsl
+struct Ray
+{
+    glm::vec3 o;
+    float min_t;
+    glm::vec3 d;
+    float max_t;
+    glm::vec3 rcpD;
+
+    Ray() {}
+    Ray(glm::vec3 o, glm::vec3 d, float min_t, float max_t) : o(o), min_t(min_t), d(d), max_t(max_t), rcpD(1.0f / d) {}
+};
+
+struct Intersection
+{
+    glm::vec3 bary;
+    int32 i1, i2, i3;
+    uint32 triangle; // Offset of the triangle in the index buffer
+};
+
+// N triangles in SoA layout, so one ray can be tested against all of them at once.
+// Unused lanes have triangle = -1.
+template <uint32 N>
+struct alignas(32) TriangleBlock
+{
+    float p1[3][N];
+    float p2[3][N];
+    float p3[3][N];
+    int32 triangle[N];
+};
+
+// Traversal work counters, accumulated by TraceRay / TraceOcclusion when passed in
+struct TraceStats
+{
+    uint64 nodesVisited = 0;
+    uint64 trianglesTested = 0;
+};
+
+typedef TriangleBlock<4> TriangleBlock4;
+typedef TriangleBlock<8> TriangleBlock8;
+
+bool IntersectBBox(const Ray& r, glm::vec3 a, glm::vec3 b);
+
+// Scalar Moller-Trumbore, same as intersect() in intersections.glsl
+bool Intersect(Ray& r, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, Intersection& isect);
+
+// Watertight (Woop et al. 2013) ray vs. N triangles, keeps the closest hit
+bool IntersectTriangles(Ray& r, const TriangleBlock4& block, Intersection& isect);
+bool IntersectTriangles(Ray& r, const TriangleBlock8& block, Intersection& isect);
+
+// Same test without barycentrics or a division, only reports whether any lane hits within [min_t, max_t]
+bool OccludedTriangles(const Ray& r, const TriangleBlock4& block);
+bool OccludedTriangles(const Ray& r, const TriangleBlock8& block);
+
+// Closest hit traversal of the skip-link BVH; leaf triangles are gathered into blocks of TRACER_BLOCK_WIDTH
+bool TraceRay(const std::vector<BVHNode>& nodes, const std::vector<glm::vec4>& vertices, const std::vector<uint32>& indices, Ray& r, Intersection& isect, TraceStats* stats = nullptr);
+
+// Any hit traversal for shadow rays, stops at the first occluder and leaves r untouched.
+// occluder (optional) holds the leaf that blocked the previous shadow ray of the same path / pixel;
+// it is tested before the traversal and updated on a hit.
+bool TraceOcclusion(const std::vector<BVHNode>& nodes, const std::vector<glm::vec4>& vertices, const std::vector<uint32>& indices, const Ray& r, uint32* occluder = nullptr, TraceStats* stats = nullptr);
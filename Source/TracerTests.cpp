@@ -0,0 +1,246 @@
+#include <Ganymede/Source/Ganymede.h>
+
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "Tracer.h"
+#include "TracerWide.h"
+
+// Checks every wide triangle kernel variant the build can target against the scalar Intersect():
+//   PathTracerTests
+// Returns non zero when a variant disagrees. Built and registered with ctest by CMakeLists.txt.
+
+// Hits closer than this to an edge (in barycentrics) may differ between the watertight and the scalar test
+static const float EdgeTolerance = 1e-4f;
+
+struct TestRun
+{
+    std::string name;
+    uint64 checks = 0;
+    uint64 failures = 0;
+
+    void Check(bool ok, const char* what, uint64 index)
+    {
+        checks++;
+        if (ok) return;
+
+        if (failures++ < 10) GanymedePrint name, "failed:", what, "case", index;
+    }
+};
+
+template <uint32 N>
+struct TestBlock
+{
+    TriangleBlock<N> block;
+    glm::vec3 p[N][3];
+    uint32 count = 0;
+
+    TestBlock()
+    {
+        for (uint32 lane = 0; lane < N; lane++)
+        {
+            block.triangle[lane] = -1;
+            for (uint32 k = 0; k < 3; k++) block.p1[k][lane] = block.p2[k][lane] = block.p3[k][lane] = 0.0f;
+        }
+    }
+
+    void Add(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
+    {
+        p[count][0] = p1; p[count][1] = p2; p[count][2] = p3;
+        for (uint32 k = 0; k < 3; k++)
+        {
+            block.p1[k][count] = p1[k];
+            block.p2[k][count] = p2[k];
+            block.p3[k][count] = p3[k];
+        }
+        block.triangle[count] = int32(count * 3);
+        count++;
+    }
+};
+
+// Closest hit of the lanes through the scalar test, isect.triangle is the lane's block.triangle
+template <uint32 N>
+static bool IntersectScalar(Ray& r, const TestBlock<N>& test, Intersection& isect)
+{
+    bool hit = false;
+    for (uint32 lane = 0; lane < test.count; lane++)
+    {
+        if (Intersect(r, test.p[lane][0], test.p[lane][1], test.p[lane][2], isect))
+        {
+            isect.triangle = uint32(test.block.triangle[lane]);
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+static float MinBary(glm::vec3 bary)
+{
+    return std::min(bary.x, std::min(bary.y, bary.z));
+}
+
+static bool Glancing(const Ray& r, const glm::vec3 p[3])
+{
+    glm::vec3 n = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+    return std::abs(glm::dot(n, r.d)) < 0.01f;
+}
+
+static bool Near(float a, float b, float tolerance)
+{
+    return std::abs(a - b) <= tolerance * std::max(1.0f, std::max(std::abs(a), std::abs(b)));
+}
+
+// Random triangles in the unit cube, rays from outside aimed at a random point of a random lane (or nowhere)
+template <typename S, uint32 N>
+static void TestRandom(TestRun& run, uint32 numCases)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> bary(0.0f, 1.0f);
+
+    auto point = [&](float scale) { return glm::vec3(unit(rng), unit(rng), unit(rng)) * scale; };
+
+    for (uint32 i = 0; i < numCases; i++)
+    {
+        TestBlock<N> test;
+        uint32 count = 1 + rng() % N;
+        while (test.count < count)
+        {
+            glm::vec3 p1 = point(1.0f), p2 = point(1.0f), p3 = point(1.0f);
+
+            // Slivers make the scalar reference itself imprecise
+            if (glm::length(glm::cross(p2 - p1, p3 - p1)) < 0.05f) continue;
+
+            test.Add(p1, p2, p3);
+        }
+
+        glm::vec3 o = point(3.0f);
+        glm::vec3 target = point(1.0f);
+        if (i % 4 != 0)
+        {
+            uint32 lane = rng() % count;
+            float a = bary(rng), b = bary(rng);
+            if (a + b > 1.0f) { a = 1.0f - a; b = 1.0f - b; }
+            target = test.p[lane][0] * (1.0f - a - b) + test.p[lane][1] * a + test.p[lane][2] * b;
+        }
+
+        float maxT = (i % 3 == 0) ? bary(rng) * 4.0f : std::numeric_limits<float>::infinity();
+        Ray ray(o, glm::normalize(target - o), 0.001f, maxT);
+
+        Ray rScalar = ray, rWide = ray;
+        Intersection isectScalar, isectWide;
+        bool hitScalar = IntersectScalar(rScalar, test, isectScalar);
+        bool hitWide = IntersectTrianglesWide<S>(rWide, test.block, isectWide);
+        bool occluded = OccludedWide<S>(ray, test.block);
+
+        // Hits near an edge, at a glancing angle and near ties between lanes are allowed to go either way
+        bool ambiguous =
+            (hitScalar && MinBary(isectScalar.bary) < EdgeTolerance) ||
+            (hitScalar && Glancing(ray, test.p[isectScalar.triangle / 3])) ||
+            (hitWide && MinBary(isectWide.bary) < EdgeTolerance) ||
+            (hitScalar && hitWide && isectScalar.triangle != isectWide.triangle && Near(rScalar.max_t, rWide.max_t, 1e-4f)) ||
+            (hitScalar && (Near(rScalar.max_t, ray.min_t, 1e-4f) || Near(rScalar.max_t, ray.max_t, 1e-4f)));
+
+        if (ambiguous) continue;
+
+        run.Check(hitScalar == hitWide, "hit", i);
+        run.Check(occluded == hitScalar, "occluded", i);
+
+        if (hitScalar && hitWide)
+        {
+            run.Check(isectScalar.triangle == isectWide.triangle, "triangle", i);
+            run.Check(Near(rScalar.max_t, rWide.max_t, 1e-4f), "t", i);
+            run.Check(
+                Near(isectScalar.bary.x, isectWide.bary.x, 1e-3f) &&
+                Near(isectScalar.bary.y, isectWide.bary.y, 1e-3f) &&
+                Near(isectScalar.bary.z, isectWide.bary.z, 1e-3f), "barycentrics", i);
+        }
+    }
+}
+
+// A fan of N triangles around a shared center vertex. Rays through the center or exactly along a shared edge
+// must hit some lane (watertightness), at the distance of the fan's plane.
+template <typename S, uint32 N>
+static void TestGrazing(TestRun& run, uint32 numCases)
+{
+    std::mt19937 rng(5678);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    for (uint32 i = 0; i < numCases; i++)
+    {
+        glm::vec3 center(unit(rng), unit(rng), unit(rng));
+        glm::vec3 normal = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.0f, 0.0f, 0.01f));
+        glm::vec3 tangent = glm::normalize(glm::cross(normal, std::abs(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+
+        glm::vec3 rim[N];
+        for (uint32 k = 0; k < N; k++)
+        {
+            float angle = 6.2831853f * float(k) / float(N);
+            rim[k] = center + (tangent * std::cos(angle) + bitangent * std::sin(angle)) * 0.5f;
+        }
+
+        TestBlock<N> test;
+        for (uint32 k = 0; k < N; k++) test.Add(center, rim[k], rim[(k + 1) % N]);
+
+        // Through the shared vertex, the middle of a shared edge, or a point on a shared edge
+        glm::vec3 target = center;
+        if (i % 3 == 1) target = (center + rim[rng() % N]) * 0.5f;
+        if (i % 3 == 2) target = glm::mix(center, rim[rng() % N], std::abs(unit(rng)));
+
+        glm::vec3 dir = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.5f + normal * (i % 2 ? 1.0f : -1.0f));
+        glm::vec3 o = target - dir * (1.0f + std::abs(unit(rng)));
+
+        // Keep glancing directions out, the edge position itself is what is being tested
+        if (std::abs(glm::dot(dir, normal)) < 0.1f) continue;
+
+        Ray ray(o, dir, 0.001f, std::numeric_limits<float>::infinity());
+        float planeT = glm::dot(center - o, normal) / glm::dot(dir, normal);
+
+        Ray rWide = ray;
+        Intersection isect;
+        bool hit = IntersectTrianglesWide<S>(rWide, test.block, isect);
+
+        run.Check(hit, "watertight hit", i);
+        run.Check(OccludedWide<S>(ray, test.block), "watertight occluded", i);
+        if (hit) run.Check(Near(rWide.max_t, planeT, 1e-3f), "watertight t", i);
+
+        // Parallel to the fan and just off its plane, no lane may report a hit (det == 0 must not leak NaNs through)
+        Ray parallel(center - tangent * 2.0f + normal * 0.01f, tangent, 0.001f, std::numeric_limits<float>::infinity());
+        Ray rParallel = parallel;
+        run.Check(!IntersectTrianglesWide<S>(rParallel, test.block, isect), "parallel hit", i);
+        run.Check(!OccludedWide<S>(parallel, test.block), "parallel occluded", i);
+    }
+}
+
+template <typename S, uint32 N>
+static bool TestVariant(const char* name)
+{
+    TestRun run;
+    run.name = name;
+
+    TestRandom<S, N>(run, 200000);
+    TestGrazing<S, N>(run, 20000);
+
+    GanymedePrint name, run.checks, "checks,", run.failures, "failures";
+    return run.failures == 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool ok = true;
+
+    ok &= TestVariant<LanesGeneric<4>, 4>("generic x4");
+    ok &= TestVariant<LanesGeneric<8>, 8>("generic x8");
+#ifdef TRACER_SSE
+    ok &= TestVariant<LanesSSE, 4>("SSE");
+#endif
+#ifdef __AVX__
+    ok &= TestVariant<LanesAVX, 8>("AVX");
+#else
+    GanymedePrint "AVX not enabled in this build, PathTracerTestsAVX covers it";
+#endif
+
+    return ok ? 0 : 1;
+}
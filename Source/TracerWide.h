@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+#include "Tracer.h"
+
+// The wide ray / triangle kernels behind IntersectTriangles and OccludedTriangles, templated on the lane type so
+// every variant the compiler can target is reachable (Tracer.cpp picks one per block width, the tests check all).
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRACER_SSE
+#include <immintrin.h>
+#endif
+
+// Lane abstractions for the wide kernel. F is a vector of floats, M a per lane mask.
+template <uint32 N>
+struct LanesGeneric
+{
+    struct F { float v[N]; };
+    struct M { bool v[N]; };
+
+    static F Set1(float a) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = a; return r; }
+    static F Load(const float* p) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = p[i]; return r; }
+    static void Store(float* p, F a) { for (uint32 i = 0; i < N; i++) p[i] = a.v[i]; }
+    static M Valid(const int32* p) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = p[i] >= 0; return r; }
+
+    static F Add(F a, F b) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+    static F Sub(F a, F b) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+    static F Mul(F a, F b) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+    static F Div(F a, F b) { F r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] / b.v[i]; return r; }
+
+    static M Lt(F a, F b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] < b.v[i]; return r; }
+    static M Gt(F a, F b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] > b.v[i]; return r; }
+    static M Neq(F a, F b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] != b.v[i]; return r; }
+
+    static M Or(M a, M b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] || b.v[i]; return r; }
+    static M And(M a, M b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] && b.v[i]; return r; }
+    static M AndNot(M a, M b) { M r; for (uint32 i = 0; i < N; i++) r.v[i] = a.v[i] && !b.v[i]; return r; }
+    static uint32 Bits(M a) { uint32 r = 0; for (uint32 i = 0; i < N; i++) r |= uint32(a.v[i]) << i; return r; }
+};
+
+#ifdef TRACER_SSE
+struct LanesSSE
+{
+    typedef __m128 F;
+    typedef __m128 M;
+
+    static F Set1(float a) { return _mm_set1_ps(a); }
+    static F Load(const float* p) { return _mm_load_ps(p); }
+    static void Store(float* p, F a) { _mm_store_ps(p, a); }
+    static M Valid(const int32* p) { return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_load_si128((const __m128i*)p), _mm_set1_epi32(-1))); }
+
+    static F Add(F a, F b) { return _mm_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm_div_ps(a, b); }
+
+    static M Lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static M Gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static M Neq(F a, F b) { return _mm_cmpneq_ps(a, b); }
+
+    static M Or(M a, M b) { return _mm_or_ps(a, b); }
+    static M And(M a, M b) { return _mm_and_ps(a, b); }
+    static M AndNot(M a, M b) { return _mm_andnot_ps(b, a); }
+    static uint32 Bits(M a) { return uint32(_mm_movemask_ps(a)); }
+};
+#endif
+
+#ifdef __AVX__
+struct LanesAVX
+{
+    typedef __m256 F;
+    typedef __m256 M;
+
+    static F Set1(float a) { return _mm256_set1_ps(a); }
+    static F Load(const float* p) { return _mm256_load_ps(p); }
+    static void Store(float* p, F a) { _mm256_store_ps(p, a); }
+    static M Valid(const int32* p) { return _mm256_cmp_ps(_mm256_cvtepi32_ps(_mm256_load_si256((const __m256i*)p)), _mm256_setzero_ps(), _CMP_GE_OQ); }
+
+    static F Add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F Sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F Mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F Div(F a, F b) { return _mm256_div_ps(a, b); }
+
+    static M Lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static M Gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static M Neq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+
+    static M Or(M a, M b) { return _mm256_or_ps(a, b); }
+    static M And(M a, M b) { return _mm256_and_ps(a, b); }
+    static M AndNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+    static uint32 Bits(M a) { return uint32(_mm256_movemask_ps(a)); }
+};
+#endif
+
+// Per lane results of the watertight test before the t range check
+template <typename S>
+struct WideTriangleTest
+{
+    typename S::F u, v, w;
+    typename S::F det;
+    typename S::F scaledT; // t * det
+    typename S::M valid;
+};
+
+template <typename S, uint32 N>
+inline WideTriangleTest<S> TestTrianglesWide(const Ray& r, const TriangleBlock<N>& block)
+{
+    typedef typename S::F F;
+    typedef typename S::M M;
+
+    WideTriangleTest<S> test;
+
+    // Permute the axes so the largest direction component becomes z, then shear the ray onto +z
+    glm::vec3 absD = glm::abs(r.d);
+    int32 kz = (absD.x > absD.y) ? (absD.x > absD.z ? 0 : 2) : (absD.y > absD.z ? 1 : 2);
+    int32 kx = (kz + 1) % 3;
+    int32 ky = (kx + 1) % 3;
+    if (r.d[kz] < 0.0f) std::swap(kx, ky);
+
+    float shearZ = 1.0f / r.d[kz];
+    F sx = S::Set1(r.d[kx] * shearZ);
+    F sy = S::Set1(r.d[ky] * shearZ);
+    F sz = S::Set1(shearZ);
+
+    F ox = S::Set1(r.o[kx]);
+    F oy = S::Set1(r.o[ky]);
+    F oz = S::Set1(r.o[kz]);
+
+    F az = S::Sub(S::Load(block.p1[kz]), oz);
+    F bz = S::Sub(S::Load(block.p2[kz]), oz);
+    F cz = S::Sub(S::Load(block.p3[kz]), oz);
+
+    F ax = S::Sub(S::Sub(S::Load(block.p1[kx]), ox), S::Mul(sx, az));
+    F ay = S::Sub(S::Sub(S::Load(block.p1[ky]), oy), S::Mul(sy, az));
+    F bx = S::Sub(S::Sub(S::Load(block.p2[kx]), ox), S::Mul(sx, bz));
+    F by = S::Sub(S::Sub(S::Load(block.p2[ky]), oy), S::Mul(sy, bz));
+    F cx = S::Sub(S::Sub(S::Load(block.p3[kx]), ox), S::Mul(sx, cz));
+    F cy = S::Sub(S::Sub(S::Load(block.p3[ky]), oy), S::Mul(sy, cz));
+
+    // Scaled barycentrics, an edge exactly through the ray counts as inside for both neighbours
+    test.u = S::Sub(S::Mul(cx, by), S::Mul(cy, bx));
+    test.v = S::Sub(S::Mul(ax, cy), S::Mul(ay, cx));
+    test.w = S::Sub(S::Mul(bx, ay), S::Mul(by, ax));
+
+    F zero = S::Set1(0.0f);
+    M anyNegative = S::Or(S::Or(S::Lt(test.u, zero), S::Lt(test.v, zero)), S::Lt(test.w, zero));
+    M anyPositive = S::Or(S::Or(S::Gt(test.u, zero), S::Gt(test.v, zero)), S::Gt(test.w, zero));
+
+    test.det = S::Add(S::Add(test.u, test.v), test.w);
+    test.scaledT = S::Mul(sz, S::Add(S::Add(S::Mul(test.u, az), S::Mul(test.v, bz)), S::Mul(test.w, cz)));
+
+    test.valid = S::AndNot(S::And(S::Valid(block.triangle), S::Neq(test.det, zero)), S::And(anyNegative, anyPositive));
+
+    return test;
+}
+
+template <typename S, uint32 N>
+bool IntersectTrianglesWide(Ray& r, const TriangleBlock<N>& block, Intersection& isect)
+{
+    typedef typename S::F F;
+    typedef typename S::M M;
+
+    WideTriangleTest<S> test = TestTrianglesWide<S>(r, block);
+
+    F rcpDet = S::Div(S::Set1(1.0f), test.det);
+    F t = S::Mul(test.scaledT, rcpDet);
+
+    M valid = S::And(test.valid, S::And(S::Gt(t, S::Set1(r.min_t)), S::Lt(t, S::Set1(r.max_t))));
+
+    uint32 mask = S::Bits(valid);
+    if (mask == 0) return false;
+
+    alignas(32) float tLanes[N];
+    S::Store(tLanes, t);
+
+    uint32 lane = 0;
+    float tClosest = std::numeric_limits<float>::infinity();
+    for (uint32 i = 0; i < N; i++)
+    {
+        if ((mask & (1u << i)) && tLanes[i] < tClosest)
+        {
+            tClosest = tLanes[i];
+            lane = i;
+        }
+    }
+
+    alignas(32) float uLanes[N], vLanes[N], wLanes[N], rcpDetLanes[N];
+    S::Store(uLanes, test.u);
+    S::Store(vLanes, test.v);
+    S::Store(wLanes, test.w);
+    S::Store(rcpDetLanes, rcpDet);
+
+    r.max_t = tClosest;
+
+    isect.bary = glm::vec3(uLanes[lane], vLanes[lane], wLanes[lane]) * rcpDetLanes[lane];
+    isect.triangle = uint32(block.triangle[lane]);
+
+    return true;
+}
+
+// Any hit: the t range is checked on t * det with the sign of det, so there is no division at all
+template <typename S, uint32 N>
+bool OccludedWide(const Ray& r, const TriangleBlock<N>& block)
+{
+    typedef typename S::F F;
+    typedef typename S::M M;
+
+    WideTriangleTest<S> test = TestTrianglesWide<S>(r, block);
+
+    F zero = S::Set1(0.0f);
+    F minT = S::Mul(S::Set1(r.min_t), test.det);
+    F maxT = S::Mul(S::Set1(r.max_t), test.det);
+
+    M inFront = S::And(S::Gt(test.det, zero), S::And(S::Gt(test.scaledT, minT), S::Lt(test.scaledT, maxT)));
+    M inBack = S::And(S::Lt(test.det, zero), S::And(S::Lt(test.scaledT, minT), S::Gt(test.scaledT, maxT)));
+
+    return S::Bits(S::And(test.valid, S::Or(inFront, inBack))) != 0;
+}
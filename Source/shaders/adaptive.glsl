@@ -0,0 +1,41 @@
+// Adaptive sampling. resolve.comp keeps the second moment of each pixel's sample luminance next to the accumulation
+// image, converge.comp marks the CONVERGENCE_TILE_SIZE squared tiles whose relative error is below convergenceThreshold.
+// Pixels of marked tiles launch no paths, except every ADAPTIVE_REFRESH_FRAMES frames so a tile that converged on a
+// lucky estimate gets checked again.
+
+#define ADAPTIVE_MIN_SAMPLES 16.0
+#define ADAPTIVE_REFRESH_FRAMES 16
+
+// One entry per tile of the frame, row major
+layout(std430, binding = 25) buffer convergenceMaskBuffer
+{
+    uint convergenceMask[];
+};
+
+// Sum of squared sample luminance per frame pixel, reset by resolve.comp together with the accumulation
+layout(std430, binding = 26) buffer luminanceMomentBuffer
+{
+    float luminanceMoments[];
+};
+
+float luminance(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+uint convergenceTileIndex(uvec2 pixel)
+{
+    uint tilesX = (uint(viewportSize.x) + CONVERGENCE_TILE_SIZE - 1) / CONVERGENCE_TILE_SIZE;
+    return (pixel.y / CONVERGENCE_TILE_SIZE) * tilesX + pixel.x / CONVERGENCE_TILE_SIZE;
+}
+
+// Launch and resolve make the same call, sampleCount is the accumulation alpha before this frame's samples.
+// The count check keeps a stale mask from skipping pixels right after the accumulation was cleared, and nothing is
+// skipped while the camera moves.
+bool pixelConverged(uvec2 pixel, float sampleCount)
+{
+    if (convergenceThreshold <= 0.0 || reproject != 0 || sampleCount < ADAPTIVE_MIN_SAMPLES) return false;
+    if (frameIndex % ADAPTIVE_REFRESH_FRAMES == 0) return false;
+
+    return convergenceMask[convergenceTileIndex(pixel)] != 0;
+}
@@ -0,0 +1,17 @@
+// Dense list of the live jobs written by compact.comp, read by the COMPACTED trace variant and the radix sort.
+// Their dispatches are sized for every job of the tile, groups past liveCount return right away.
+
+#define COMPACTION_TRACE_GROUP_SIZE 64
+
+layout(std430, binding = 18) buffer liveJobBuffer
+{
+    JobDesc liveJobs[];
+};
+
+layout(std430, binding = 19) buffer compactionStateBuffer
+{
+    uint liveCount;
+    uint partitionCounter;
+    uint workCounter; // Next batch of the persistent threads trace
+    uint partitionStatus[];
+};
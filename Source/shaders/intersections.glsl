@@ -54,6 +54,32 @@ bool intersect(inout Ray r, Triangle tri, inout Intersection isect)
     return true;
 }
 
+// Cheaper test for shadow rays: no barycentrics, rejects on alpha before the second cross product
+bool intersectAny(Ray r, vec3 p1, vec3 p2, vec3 p3)
+{
+    vec3 e1 = p2 - p1;
+    vec3 e2 = p3 - p1;
+    vec3 s = r.o - p1, s1 = cross(r.d, e2);
+    float invDet = 1.0f / dot(s1, e1);
+
+    float alpha = dot(s1, s) * invDet;
+    if (alpha < 0.0 || alpha > 1.0) return false;
+
+    vec3 s2 = cross(s, e1);
+    float beta = dot(s2, r.d) * invDet;
+    if (beta < 0.0 || alpha + beta > 1.0) return false;
+
+    float t = dot(s2, e2) * invDet;
+    return t >= r.min_t && t <= r.max_t;
+}
+
+bool intersectLeafAny(Ray r, uint index)
+{
+    ivec3 tindex = ivec3(texelFetch(indicies, -bvh[index].right / 3).xyz);
+
+    return intersectAny(r, vertexPosition(tindex.x), vertexPosition(tindex.y), vertexPosition(tindex.z));
+}
+
 bool traceRay(inout Ray r, out Intersection isect, bool stopIfHit)
 {
     bool hit = false;
@@ -89,9 +115,9 @@ bool traceRay(inout Ray r, out Intersection isect, bool stopIfHit)
                 tri.i2 = tindex.y;
                 tri.i3 = tindex.z;
 
-                tri.p1 = texelFetch(vertices, tindex.x).xyz;
-                tri.p2 = texelFetch(vertices, tindex.y).xyz;
-                tri.p3 = texelFetch(vertices, tindex.z).xyz;
+                tri.p1 = vertexPosition(tindex.x);
+                tri.p2 = vertexPosition(tindex.y);
+                tri.p3 = vertexPosition(tindex.z);
 
                 if (intersect(r, tri, isect))
                 {
@@ -112,4 +138,40 @@ bool traceRay(inout Ray r, out Intersection isect, bool stopIfHit)
 
     r.origBvhId = int(hitIndex);
     return hit;
+}
+
+// Any-hit traversal for shadow rays. Never writes an Intersection or r.max_t and stops at the first occluder.
+// occluder is the leaf that blocked the last shadow ray of this pixel, it is tried before walking the tree.
+bool traceShadowRay(Ray r, inout uint occluder)
+{
+    if (occluder != 0 && occluder < numBVHNodes && occluder != r.origBvhId && bvh[occluder].right <= 0 && intersectLeafAny(r, occluder)) return true;
+
+    uint index = 0;
+
+    while (index < numBVHNodes)
+    {
+        bool bboxIsectResult = intersectBBox(r, bvh[index].a, bvh[index].b);
+
+        #ifdef SPECULATIVE
+        if (anyInvocationARB(bboxIsectResult))
+        #else
+        if (bboxIsectResult)
+        #endif
+        {
+            if (bvh[index].right <= 0 && (r.origBvhId == 0 || r.origBvhId != index) && intersectLeafAny(r, index))
+            {
+                occluder = index;
+                return true;
+            }
+
+            index++;
+        }
+        else
+        {
+            index = bvh[index].next;
+            if (index == 0) return false;
+        }
+    }
+
+    return false;
 }
\ No newline at end of file
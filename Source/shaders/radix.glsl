@@ -0,0 +1,175 @@
+// LSD radix sort of (key, value) pairs in sortPairs, 8 bits per pass: (HISTOGRAM, SCAN, SCATTER) x RADIX_PASSES,
+// each over blocks of RADIX_BLOCK_SIZE pairs with RADIX_DIGITS threads. Used by radixsort.comp and bvhbuild.comp.
+// The includer defines RADIX_COUNT (number of pairs) and RADIX_HALF (offset of the second half of sortPairs), and may
+// define RADIX_WRITE_LAST(dst, pair) to redirect the last scatter, which otherwise leaves the pairs in the first half.
+
+// (key, value), two halves the passes ping-pong between
+layout(std430, binding = 20) buffer sortPairBuffer
+{
+    uvec2 sortPairs[];
+};
+
+// radixPass is the pass of the next HISTOGRAM, SCAN copies it to scatterPass and advances it.
+// blockOffsets holds the digit counts of every block, then their global offsets after SCAN.
+layout(std430, binding = 21) buffer sortStateBuffer
+{
+    uint radixPass;
+    uint scatterPass;
+    uint blockOffsets[];
+};
+
+uint pairBase(uint pass)
+{
+    return (pass & 1) * (RADIX_HALF);
+}
+
+uint digitOf(uint key, uint pass)
+{
+    return (key >> (pass * 8)) & (RADIX_DIGITS - 1);
+}
+
+// Spreads the low 10 bits of v to every third bit, for Morton code keys
+uint expandBits(uint v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+#ifdef HISTOGRAM
+
+shared uint counts[RADIX_DIGITS];
+
+void main()
+{
+    uint localIndex = gl_LocalInvocationIndex;
+    uint block = gl_WorkGroupID.x;
+    uint pass = radixPass;
+    uint base = pairBase(pass);
+    uint count = RADIX_COUNT;
+
+    counts[localIndex] = 0;
+    barrier();
+
+    for (uint i = block * RADIX_BLOCK_SIZE + localIndex; i < min((block + 1) * RADIX_BLOCK_SIZE, count); i += RADIX_DIGITS)
+    {
+        atomicAdd(counts[digitOf(sortPairs[base + i].x, pass)], 1);
+    }
+
+    barrier();
+
+    blockOffsets[block * RADIX_DIGITS + localIndex] = counts[localIndex];
+}
+
+#endif
+
+#ifdef SCAN
+
+shared uint digitBase[RADIX_DIGITS];
+
+// One workgroup, one thread per digit: offsets of a digit in a block are all smaller digits in all blocks plus the
+// same digit in the blocks before
+void main()
+{
+    uint digit = gl_LocalInvocationIndex;
+    uint numBlocks = (RADIX_COUNT + RADIX_BLOCK_SIZE - 1) / RADIX_BLOCK_SIZE;
+
+    uint total = 0;
+    for (uint block = 0; block < numBlocks; block++)
+    {
+        uint count = blockOffsets[block * RADIX_DIGITS + digit];
+        blockOffsets[block * RADIX_DIGITS + digit] = total;
+        total += count;
+    }
+
+    // Inclusive scan of the digit totals
+    digitBase[digit] = total;
+    barrier();
+
+    for (uint offset = 1; offset < RADIX_DIGITS; offset <<= 1)
+    {
+        uint value = digit >= offset ? digitBase[digit - offset] : 0;
+        barrier();
+        digitBase[digit] += value;
+        barrier();
+    }
+
+    uint exclusive = digitBase[digit] - total;
+
+    for (uint block = 0; block < numBlocks; block++)
+    {
+        blockOffsets[block * RADIX_DIGITS + digit] += exclusive;
+    }
+
+    if (digit == 0)
+    {
+        scatterPass = radixPass;
+        radixPass = radixPass + 1;
+    }
+}
+
+#endif
+
+#ifdef SCATTER
+
+shared uint digitOffset[RADIX_DIGITS];
+shared uint chunkDigits[RADIX_DIGITS];
+shared uint chunkCounts[RADIX_DIGITS];
+
+// Stable: the block is moved in chunks of RADIX_DIGITS pairs, inside a chunk the rank of a pair is the number of
+// earlier pairs with the same digit
+void main()
+{
+    uint localIndex = gl_LocalInvocationIndex;
+    uint block = gl_WorkGroupID.x;
+    uint pass = scatterPass;
+    uint srcBase = pairBase(pass);
+    uint dstBase = pairBase(pass + 1);
+    uint count = RADIX_COUNT;
+
+    digitOffset[localIndex] = blockOffsets[block * RADIX_DIGITS + localIndex];
+    chunkCounts[localIndex] = 0;
+
+    for (uint chunk = block * RADIX_BLOCK_SIZE; chunk < min((block + 1) * RADIX_BLOCK_SIZE, count); chunk += RADIX_DIGITS)
+    {
+        uint i = chunk + localIndex;
+        bool valid = i < count;
+
+        uvec2 pair = valid ? sortPairs[srcBase + i] : uvec2(0);
+        uint digit = valid ? digitOf(pair.x, pass) : RADIX_DIGITS;
+
+        chunkDigits[localIndex] = digit;
+        barrier();
+
+        if (valid)
+        {
+            uint rank = 0;
+            for (uint j = 0; j < localIndex; j++)
+            {
+                if (chunkDigits[j] == digit) rank++;
+            }
+
+            atomicAdd(chunkCounts[digit], 1);
+
+            uint dst = digitOffset[digit] + rank;
+
+#ifdef RADIX_WRITE_LAST
+            if (pass == RADIX_PASSES - 1)
+                RADIX_WRITE_LAST(dst, pair);
+            else
+#endif
+                sortPairs[dstBase + dst] = pair;
+        }
+
+        barrier();
+
+        digitOffset[localIndex] += chunkCounts[localIndex];
+        chunkCounts[localIndex] = 0;
+
+        barrier();
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+// Temporal reprojection. The trace passes store the first hit distance of every pixel, when the camera moves
+// history.comp snapshots the accumulation together with those distances and resolve.comp starts the pixels from the
+// reprojected snapshot instead of zero. A history sample whose distance to the previous camera disagrees with the
+// stored one is disoccluded and dropped.
+
+#define REPROJECT_DEPTH_TOLERANCE 0.05
+// Reprojected history counts as at most this many samples, so it fades as new samples come in
+#define REPROJECT_MAX_SAMPLES 32.0
+// Stand-in distance for primary rays that missed, only the direction matters for them
+#define REPROJECT_SKY_DISTANCE 10000.0
+
+// Distance along the primary ray of sample 0 per frame pixel, 0 for a miss
+layout(std430, binding = 27) buffer primaryDepthBuffer
+{
+    float primaryDepth[];
+};
+
+layout(binding = 28, rgba32f) uniform image2D history;
+
+// Per frame pixel: primaryDepth and the adaptive.glsl luminance moment of the history
+layout(std430, binding = 29) buffer historySampleBuffer
+{
+    vec2 historySamples[];
+};
+
+uint framePixelIndex(uvec2 pixel)
+{
+    return pixel.y * uint(viewportSize.x) + pixel.x;
+}
+
+// Called by the trace passes for every depth 0 ray. Without reprojection the buffer holds a single entry and the
+// bounds check drops the writes.
+void storePrimaryDepth(uint job, float t)
+{
+    if (job >= tilePixelCount()) return;
+
+    uint index = framePixelIndex(jobPixel(job));
+    if (index < uint(primaryDepth.length())) primaryDepth[index] = t;
+}
+
+// Accumulation of the previous view at the current surface of the pixel, zero when it was not visible.
+// Also returns the luminance moment that goes with it, both scaled down to REPROJECT_MAX_SAMPLES.
+vec4 reprojectHistory(uvec2 pixel, out float moment)
+{
+    moment = 0.0;
+
+    vec4 projPos = vec4(((vec2(pixel) + 0.5) / viewportSize) * 2.0 - 1.0, 1.0, 1.0);
+    vec4 viewPos = projInvMtx * projPos; viewPos /= viewPos.w;
+    vec4 camPos = viewInvMtx * vec4(0.0, 0.0, 0.0, 1.0); camPos /= camPos.w;
+    vec3 dir = normalize((viewInvMtx * viewPos).xyz - camPos.xyz);
+
+    float depth = primaryDepth[framePixelIndex(pixel)];
+    vec3 worldPos = camPos.xyz + dir * (depth > 0.0 ? depth : REPROJECT_SKY_DISTANCE);
+
+    vec4 prevView = prevViewMtx * vec4(worldPos, 1.0);
+    vec4 prevClip = prevProjMtx * prevView;
+    if (prevClip.w <= 0.0) return vec4(0.0);
+
+    vec2 prevPixel = (prevClip.xy / prevClip.w * 0.5 + 0.5) * viewportSize;
+    if (any(lessThan(prevPixel, vec2(0.0))) || any(greaterThanEqual(prevPixel, viewportSize))) return vec4(0.0);
+
+    vec2 prevSample = historySamples[framePixelIndex(uvec2(prevPixel))];
+
+    // Misses only match misses, hits the surface at the same distance from the previous camera
+    float expected = depth > 0.0 ? length(prevView.xyz) : 0.0;
+    if ((expected > 0.0) != (prevSample.x > 0.0)) return vec4(0.0);
+    if (abs(prevSample.x - expected) > REPROJECT_DEPTH_TOLERANCE * expected) return vec4(0.0);
+
+    vec4 acc = imageLoad(history, ivec2(prevPixel));
+    float scale = acc.a > REPROJECT_MAX_SAMPLES ? REPROJECT_MAX_SAMPLES / acc.a : 1.0;
+
+    moment = prevSample.y * scale;
+    return acc * scale;
+}
@@ -0,0 +1,242 @@
+// Scene bindings, light sampling and the shading steps shared by trace.comp and the wavefront kernels.
+// Include after noise.glsl and structures.glsl.
+
+layout(std430, binding = 1) buffer lightBuffer
+{
+    Light lights[];
+};
+
+layout(std430, binding = 2) buffer vertexBufferAux
+{
+    VertexAux vertexAux[];
+};
+
+layout(binding = 3) uniform usamplerBuffer indicies;
+
+layout(std430, binding = 4) buffer blueNoiseBuffer
+{
+    uint16_t blueNoise[];
+};
+
+// Tightly packed vec3 positions
+layout(std430, binding = 7) buffer vertexBufferPos
+{
+    float vertices[];
+};
+
+vec3 vertexPosition(int index)
+{
+    return vec3(vertices[3 * index], vertices[3 * index + 1], vertices[3 * index + 2]);
+}
+
+layout(std430, binding = 8) buffer bvhBuffer
+{
+    BVHNode bvh[];
+};
+
+layout(std430, binding = 11) buffer occluderBuffer
+{
+    uint occluderCache[];
+};
+
+layout(std430, binding = 12) buffer lightTreeBuffer
+{
+    LightNode lightTree[];
+};
+
+layout(std430, binding = 13) buffer areaLightBuffer
+{
+    AreaLight areaLights[];
+};
+
+#include "intersections.glsl"
+
+// Upper bound of the point light falloff in sampleDirectLight() over the node's bounds
+float lightNodeImportance(uint index, vec3 p)
+{
+    vec3 center = (lightTree[index].a + lightTree[index].b) * 0.5;
+    float radius = length(lightTree[index].b - lightTree[index].a) * 0.5;
+    float dist = max(length(p - center) - radius, 0.0);
+    return lightTree[index].power / (dist * dist + 1.0);
+}
+
+// Walks the light tree from the root, picking children proportional to their importance at p (SampleLightTree() on the CPU)
+uint sampleLightTree(vec3 p, float u, out float pmf)
+{
+    pmf = 1.0;
+    uint index = 0;
+
+    while (lightTree[index].child >= 0)
+    {
+        uint child = uint(lightTree[index].child);
+        float left = lightNodeImportance(child, p);
+        float right = lightNodeImportance(child + 1, p);
+        float pLeft = left + right > 0.0 ? left / (left + right) : 0.5;
+
+        // Reuse u for the next level
+        if (u < pLeft)
+        {
+            u = u / pLeft;
+            pmf *= pLeft;
+            index = child;
+        }
+        else
+        {
+            u = (u - pLeft) / (1.0 - pLeft);
+            pmf *= 1.0 - pLeft;
+            index = child + 1;
+        }
+    }
+
+    return uint(-lightTree[index].child - 1);
+}
+
+// Alias table lookup, picks an emissive triangle proportional to its power (SampleAreaLight() on the CPU)
+uint sampleAreaLight(float u, out float pmf)
+{
+    float scaled = u * float(numAreaLights);
+    uint slot = min(uint(scaled), numAreaLights - 1);
+    uint index = (scaled - float(slot)) < areaLights[slot].aliasProb ? slot : areaLights[slot].alias;
+    pmf = areaLights[index].pmf;
+    return index;
+}
+
+// Interpolated shading normal (facing the ray) and linear albedo, alpha < 0.5 marks a delta (glass) material
+void surfaceAttributes(Intersection isect, vec3 rayDir, out f16vec3 normal, out f16vec4 albedo)
+{
+    f16vec4 c1 = f16vec4(vertexAux[isect.i1].color) * (1.0hf / 255.0hf);
+    f16vec4 c2 = f16vec4(vertexAux[isect.i2].color) * (1.0hf / 255.0hf);
+    f16vec4 c3 = f16vec4(vertexAux[isect.i3].color) * (1.0hf / 255.0hf);
+
+    f16vec3 n1 = f16vec3(octDecode(vertexAux[isect.i1].normal));
+    f16vec3 n2 = f16vec3(octDecode(vertexAux[isect.i2].normal));
+    f16vec3 n3 = f16vec3(octDecode(vertexAux[isect.i3].normal));
+
+    normal = isect.bary.x * n1 + isect.bary.y * n2 + isect.bary.z * n3;
+    albedo = isect.bary.x * c1 + isect.bary.y * c2 + isect.bary.z * c3;
+    albedo.rgb = pow(albedo.rgb, f16vec3(2.2));
+
+    if (dot(normal, f16vec3(rayDir)) > 0.0) normal = -normal;
+}
+
+// Picks one direct lighting strategy and sets up its shadow ray, contribution is what the path vertex receives if
+// rLight is unoccluded
+void sampleDirectLight(vec3 hitPos, f16vec3 normal, f16vec4 albedo, Ray r, out Ray rLight, out f16vec3 contribution)
+{
+    // Direct Lighting: point lights, emissive triangles (if any) and ambient, picked uniformly
+    float numStrategies = numAreaLights > 0 ? 3.0 : 2.0;
+    float strategy = getRandF() * numStrategies;
+    float16_t falloff;
+    vec3 lightDir;
+    f16vec3 lightRadiance;
+
+    if (strategy < 1.0)
+    {
+        float lightPmf;
+        uint i = sampleLightTree(hitPos, getRandF(), lightPmf);
+
+        vec3 lightPos = lights[i].pos.xyz;
+
+        vec3 posDiff = lightPos - hitPos;
+        float dist = length(posDiff);
+        lightDir = posDiff / dist;
+                    
+        rLight.o = hitPos;
+        rLight.d = lightDir;
+        rLight.origBvhId = r.origBvhId;
+        rLight.rcpD = f16vec3(1.0 / rLight.d);
+        rLight.min_t = 0.001;
+        rLight.max_t = dist - 0.00005;
+
+        lightRadiance = f16vec3(lights[i].radiance.rgb / lightPmf);
+
+        falloff = float16_t(1.0f / (dist * dist + 1.0f)) * max(0.0hf, dot(normal, f16vec3(lightDir)));
+    }
+    else if (strategy < 2.0 && numAreaLights > 0)
+    {
+        float lightPmf;
+        uint i = sampleAreaLight(getRandF(), lightPmf);
+
+        // Uniform point on the triangle
+        float su = sqrt(getRandF());
+        float v = getRandF();
+        vec3 lightPos = (1.0 - su) * areaLights[i].p1 + su * (1.0 - v) * areaLights[i].p2 + su * v * areaLights[i].p3;
+        vec3 lightNormal = normalize(cross(areaLights[i].p2 - areaLights[i].p1, areaLights[i].p3 - areaLights[i].p1));
+
+        vec3 posDiff = lightPos - hitPos;
+        float dist = length(posDiff);
+        lightDir = posDiff / dist;
+
+        rLight.o = hitPos;
+        rLight.d = lightDir;
+        rLight.origBvhId = r.origBvhId;
+        rLight.rcpD = f16vec3(1.0 / rLight.d);
+        rLight.min_t = 0.001;
+        rLight.max_t = dist - 0.001; // Stop before the emitter itself
+
+        lightRadiance = f16vec3(areaLights[i].radiance);
+
+        // Solid angle pdf: pmf / area * dist^2 / cos, emitters are two sided. Clamped to stay within half precision.
+        float cosLight = abs(dot(lightNormal, lightDir));
+        float g = cosLight * areaLights[i].area / (3.14159265 * dist * dist * lightPmf);
+        falloff = float16_t(min(g, 1024.0)) * max(0.0hf, dot(normal, f16vec3(lightDir)));
+    }
+    else
+    {
+        f16vec2 gridSample = WeylNth(getRand());
+        lightDir = vec3(to_coord_space(normal, cosineHemisphere(gridSample)));
+        
+        rLight.o = hitPos;
+        rLight.d = lightDir;
+        rLight.origBvhId = r.origBvhId;
+        rLight.rcpD = f16vec3(1.0 / rLight.d);
+        rLight.min_t = 0.001;
+        rLight.max_t = 1000.0;
+
+        lightRadiance = f16vec3(ambientRadiance);
+
+        falloff = 1.0hf;
+    }
+
+    // For delta material, this is kind of a hack (introduce a small bias), but point light source doesn't exist anyways ...
+    if (albedo.a > 0.5)
+        contribution = float16_t(numStrategies) * falloff * albedo.rgb * lightRadiance;
+    else
+        contribution = float16_t(numStrategies) * float16_t(dot(lightDir, r.d) > 0.995) * lightRadiance;
+}
+
+// Continues the path from hitPos: refraction for delta materials, cosine weighted bounce with russian roulette otherwise.
+// Returns false when the path ends, albedo is adjusted for delta materials.
+bool sampleNextRay(int depth, bool isLastHitDelta, vec3 hitPos, f16vec3 normal, inout f16vec4 albedo, inout Ray r, out float16_t prob)
+{
+    f16vec2 gridSample = WeylNth(getRand()); //f16vec2(getRandF(), getRandF());
+    vec3 nextDir = vec3(to_coord_space(normal, cosineHemisphere(gridSample)));
+    
+    if (albedo.a < 0.5)
+    {
+        float16_t ior = 1.3hf;
+        if (depth > 0 && isLastHitDelta) ior = 1.0hf / 1.3hf;
+
+        nextDir = vec3(refract(f16vec3(r.d), normal, ior));
+
+        if (nextDir == vec3(0.0)) nextDir = vec3(reflect(f16vec3(r.d), normal));
+
+        // Prevent double counting the transmittance
+        albedo = sqrt(albedo);
+        
+        prob = 1.0hf;
+    }
+    else
+    {
+        prob = 1.0hf / 0.7hf;
+        if (getRandF() > 0.7) return false;
+    }
+
+    r.o = hitPos;
+    r.d = nextDir;
+    r.rcpD = f16vec3(1.0 / r.d);
+    r.min_t = 0.00005;
+    r.max_t = 10000.0;
+
+    return true;
+}
@@ -4,12 +4,23 @@ struct Light
     vec3 radiance;
 };
 
+// Octahedral normal (2x snorm16) and RGBA8 color, see PackedVertexAux in ShaderData.h
 struct VertexAux
 {
-    vec3 normal;
+    uint normal;
     u8vec4 color;
 };
 
+vec3 octDecode(uint packed)
+{
+    vec2 p = unpackSnorm2x16(packed);
+    vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 struct Ray
 {
     vec3 o;
@@ -40,6 +51,28 @@ struct BVHNode
     int right;
 };
 
+// Light hierarchy node, see LightTree.h
+struct LightNode
+{
+    vec3 a;
+    float power;
+    vec3 b;
+    int child;
+};
+
+// Emissive triangle with its alias table slot, see LightTree.h
+struct AreaLight
+{
+    vec3 p1;
+    float area;
+    vec3 p2;
+    uint alias;
+    vec3 p3;
+    float aliasProb;
+    vec3 radiance;
+    float pmf;
+};
+
 struct RayStackBuffer
 {
 	vec3 rayDirection;
@@ -51,11 +84,54 @@ struct RayStackBuffer
     float16_t prob;
 };
 
+// Forward accumulation: the whole path state of a pixel, see PathState in ShaderData.h
+struct PathState
+{
+    vec3 rayOrigin;
+    uint randState;
+    vec3 rayDirection;
+    uint currentDepth;
+    vec3 throughput;
+    uint lastHitDelta;
+    vec3 radiance;
+};
+
 struct JobDesc
 {
     uint32_t index;
 };
 
+// Wavefront mode, see WavefrontState in ShaderData.h
+#define WAVEFRONT_MAX_DEPTH 8
+#define WAVEFRONT_GROUP_SIZE 64
+
+// Radix sort of radix.glsl, see ShaderData.h
+#define RADIX_BLOCK_SIZE 4096
+#define RADIX_DIGITS 256
+#define RADIX_PASSES 4
+
+// Adaptive sampling of adaptive.glsl, see ShaderData.h
+#define CONVERGENCE_TILE_SIZE 8
+
+struct WavefrontHit
+{
+    uint stackIndex;
+    int i1, i2, i3;
+    f16vec4 bary;
+    float t;
+    uint leaf;
+};
+
+struct ShadowRay
+{
+    vec3 o;
+    float max_t;
+    vec3 d;
+    uint stackIndex;
+    f16vec4 contribution;
+    uint origBvhId;
+};
+
 layout(binding = 0) uniform Constants {
     mat4 viewMtx;
     mat4 projMtx;
@@ -69,4 +145,43 @@ layout(binding = 0) uniform Constants {
     uint numRays;
     uint numBVHNodes;
     vec3 ambientRadiance;
+    uint numAreaLights;
+    uint passDepth; // Path depth of the wavefront passes
+    uint forwardAccumulation; // Paths keep a PathState per pixel instead of the ray stack
+    vec2 tileSize; // Pixels rendered by this pass starting at viewportBase, the per pixel buffers are tile sized
+    uint samplesPerFrame; // Independent paths per pixel traced by each pass
+    float convergenceThreshold; // Relative error below which adaptive.glsl stops sampling a tile, 0 = off
+    uint reproject; // Camera moved, resolve.comp starts from the reprojected history, see reproject.glsl
+    mat4 prevViewMtx; // View of the history
+    mat4 prevProjMtx;
 };
+
+uint tilePixelCount()
+{
+    return uint(tileSize.x) * uint(tileSize.y);
+}
+
+// Job s * tilePixelCount() + p is sample s of tile pixel p, so the jobs of a pass form a grid of
+// tileSize.x by tileSize.y * samplesPerFrame, one tile high band per sample
+uint jobCount()
+{
+    return tilePixelCount() * samplesPerFrame;
+}
+
+uvec2 jobGridSize()
+{
+    return uvec2(uint(tileSize.x), uint(tileSize.y) * samplesPerFrame);
+}
+
+// Frame pixel of a job
+uvec2 jobPixel(uint job)
+{
+    uint pixel = job % tilePixelCount();
+    return uvec2(pixel % uint(tileSize.x), pixel / uint(tileSize.x)) + uvec2(viewportBase);
+}
+
+// Noise sequence index of a job, each sample of the frame gets its own
+uint jobFrameIndex(uint job)
+{
+    return (frameIndex * samplesPerFrame + job / tilePixelCount()) & 0xFFFF;
+}
@@ -7,7 +7,7 @@
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec4 inColor;
-layout(location = 2) in vec3 inNormal;
+layout(location = 2) in uint inNormal;
 
 layout(location = 0) out vec4 fragColor;
 layout(location = 1) out vec3 normal;
@@ -16,7 +16,7 @@ layout(location = 2) out vec4 pos;
 void main() {
     pos = viewMtx * vec4(inPosition, 1.0);
     fragColor = inColor;
-    normal = normalize(mat3(viewMtx) * inNormal);
+    normal = normalize(mat3(viewMtx) * octDecode(inNormal));
 
     gl_Position = projMtx * pos;
 }
\ No newline at end of file
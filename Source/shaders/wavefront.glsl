@@ -0,0 +1,50 @@
+// Queues between the wavefront kernels (extend -> shade -> shadow, once per depth).
+// Every counter has one slot per depth, launch.comp resets them. The consuming kernel is dispatched for every job of
+// the tile, one workgroup per WAVEFRONT_GROUP_SIZE entries, and its groups past the counter return right away.
+
+#define WAVEFRONT_GROUP_SIZE 64
+
+layout(std430, binding = 14) buffer wavefrontStateBuffer
+{
+    uint extendCount[WAVEFRONT_MAX_DEPTH];
+    uint hitCount[WAVEFRONT_MAX_DEPTH];
+    uint shadowCount[WAVEFRONT_MAX_DEPTH];
+};
+
+// Stack indices of the rays to extend, two pixel sized halves used alternately per depth
+layout(std430, binding = 15) buffer rayQueueBuffer
+{
+    uint rayQueue[];
+};
+
+layout(std430, binding = 16) buffer hitQueueBuffer
+{
+    WavefrontHit hitQueue[];
+};
+
+layout(std430, binding = 17) buffer shadowQueueBuffer
+{
+    ShadowRay shadowQueue[];
+};
+
+uint rayQueueBase(uint depth)
+{
+    return (depth & 1) * jobCount();
+}
+
+uint appendRay(uint depth, uint stackIndex)
+{
+    uint slot = atomicAdd(extendCount[depth], 1);
+    rayQueue[rayQueueBase(depth) + slot] = stackIndex;
+    return slot;
+}
+
+uint appendHit(uint depth)
+{
+    return atomicAdd(hitCount[depth], 1);
+}
+
+uint appendShadowRay(uint depth)
+{
+    return atomicAdd(shadowCount[depth], 1);
+}